@@ -0,0 +1,171 @@
+#include "ata.h"
+
+#define ATA_STATUS_ERROR 0x01
+#define ATA_STATUS_DRQ   0x08
+#define ATA_STATUS_FAULT 0x20
+#define ATA_STATUS_BUSY  0x80
+
+#define ATA_READ_SECTORS     0x20
+#define ATA_READ_SECTORS_EXT 0x24
+#define ATA_IDENTIFY         0xEC
+
+// Status polls before a request is given up; a missing or hung drive must
+// not stall the caller forever
+#define ATA_TIMEOUT 1000000
+
+
+AtaDriver::AtaDriver(uint16_t portBase, uint16_t controlBase, bool master)
+:   dataPort(portBase),
+    errorPort(portBase + 1),
+    sectorCountPort(portBase + 2),
+    lbaLowPort(portBase + 3),
+    lbaMidPort(portBase + 4),
+    lbaHighPort(portBase + 5),
+    devicePort(portBase + 6),
+    commandPort(portBase + 7),
+    controlPort(controlBase)
+{
+    this->master = master;
+    lba48 = false;
+    sectors = 0;
+}
+
+AtaDriver::~AtaDriver()
+{
+}
+
+// Four alternate status reads. The status register may still show the
+// previous state for this long after a drive select or a data block.
+void AtaDriver::Delay400ns()
+{
+    for(int i = 0; i < 4; i++)
+        controlPort.Read();
+}
+
+bool AtaDriver::WaitReady()
+{
+    for(uint32_t i = 0; i < ATA_TIMEOUT; i++)
+    {
+        uint8_t status = commandPort.Read();
+        if(!(status & ATA_STATUS_BUSY))
+            return !(status & (ATA_STATUS_ERROR | ATA_STATUS_FAULT));
+    }
+    return false;
+}
+
+bool AtaDriver::WaitData()
+{
+    for(uint32_t i = 0; i < ATA_TIMEOUT; i++)
+    {
+        uint8_t status = commandPort.Read();
+        if(status & ATA_STATUS_BUSY)
+            continue;
+        if(status & (ATA_STATUS_ERROR | ATA_STATUS_FAULT))
+            return false;
+        if(status & ATA_STATUS_DRQ)
+            return true;
+    }
+    return false;
+}
+
+bool AtaDriver::Identify()
+{
+    controlPort.Write(0x02); // nIEN: requests are polled, keep IRQ 14 quiet
+    devicePort.Write(master ? 0xA0 : 0xB0);
+    Delay400ns(); // for the drive select to settle
+
+    sectorCountPort.Write(0);
+    lbaLowPort.Write(0);
+    lbaMidPort.Write(0);
+    lbaHighPort.Write(0);
+    commandPort.Write(ATA_IDENTIFY);
+
+    uint8_t status = commandPort.Read();
+    if(status == 0 || status == 0xFF)
+        return false; // nothing attached, or a floating bus
+
+    for(uint32_t i = 0; i < ATA_TIMEOUT && (commandPort.Read() & ATA_STATUS_BUSY); i++);
+    if(lbaMidPort.Read() != 0 || lbaHighPort.Read() != 0)
+        return false; // ATAPI or SATA signature, not a PIO disk
+    if(!WaitData())
+        return false;
+
+    uint16_t identify[256];
+    for(int i = 0; i < 256; i++)
+        identify[i] = dataPort.Read();
+
+    lba48 = identify[83] & (1 << 10);
+    if(lba48)
+        sectors = (uint64_t)identify[100]
+                | ((uint64_t)identify[101] << 16)
+                | ((uint64_t)identify[102] << 32)
+                | ((uint64_t)identify[103] << 48);
+    else
+        sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    return sectors != 0;
+}
+
+bool AtaDriver::ReadCommand(uint64_t sector, uint32_t count, uint16_t* buffer)
+{
+    if(!WaitReady())
+        return false;
+
+    // A count of 0 means 256 (LBA28) or 65536 (LBA48) sectors
+    if(lba48)
+    {
+        devicePort.Write(master ? 0x40 : 0x50);
+        sectorCountPort.Write(count >> 8);
+        lbaLowPort.Write(sector >> 24);
+        lbaMidPort.Write(sector >> 32);
+        lbaHighPort.Write(sector >> 40);
+        sectorCountPort.Write(count);
+        lbaLowPort.Write(sector);
+        lbaMidPort.Write(sector >> 8);
+        lbaHighPort.Write(sector >> 16);
+        commandPort.Write(ATA_READ_SECTORS_EXT);
+    }
+    else
+    {
+        devicePort.Write((master ? 0xE0 : 0xF0) | ((sector >> 24) & 0x0F));
+        sectorCountPort.Write(count);
+        lbaLowPort.Write(sector);
+        lbaMidPort.Write(sector >> 8);
+        lbaHighPort.Write(sector >> 16);
+        commandPort.Write(ATA_READ_SECTORS);
+    }
+
+    for(uint32_t n = 0; n < count; n++)
+    {
+        // Right after a block DRQ can still read 1 from the last sector
+        Delay400ns();
+        if(!WaitData())
+            return false;
+        for(int i = 0; i < BLOCK_SECTOR_SIZE / 2; i++)
+            *buffer++ = dataPort.Read();
+    }
+    return true;
+}
+
+bool AtaDriver::Read(uint64_t sector, uint32_t count, void* buffer)
+{
+    if(sector + count > sectors)
+        return false;
+
+    uint32_t limit = lba48 ? 65536 : 256;
+    uint16_t* target = (uint16_t*)buffer;
+    while(count != 0)
+    {
+        uint32_t n = count < limit ? count : limit;
+        if(!ReadCommand(sector, n, target))
+            return false;
+        sector += n;
+        count -= n;
+        target += n * (BLOCK_SECTOR_SIZE / 2);
+    }
+    return true;
+}
+
+uint64_t AtaDriver::SectorCount()
+{
+    return sectors;
+}
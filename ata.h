@@ -0,0 +1,42 @@
+#ifndef __ATA_H
+#define __ATA_H
+
+#include "types.h"
+#include "port.h"
+#include "blockdevice.h"
+
+// PIO ATA disk on the primary or secondary legacy channel. Polled with
+// device interrupts off; a request of any length becomes as few READ
+// SECTORS (EXT) commands as the 8/16-bit sector count allows.
+class AtaDriver : public BlockDevice {
+    Port16Bit dataPort;
+    Port8Bit errorPort;
+    Port8Bit sectorCountPort;
+    Port8Bit lbaLowPort;
+    Port8Bit lbaMidPort;
+    Port8Bit lbaHighPort;
+    Port8Bit devicePort;
+    Port8Bit commandPort;
+    Port8Bit controlPort;
+
+    bool master;
+    bool lba48;
+    uint64_t sectors;
+
+    void Delay400ns();
+    bool WaitReady();
+    bool WaitData();
+    bool ReadCommand(uint64_t sector, uint32_t count, uint16_t* buffer);
+
+    public:
+        AtaDriver(uint16_t portBase, uint16_t controlBase, bool master);
+        ~AtaDriver();
+
+        // IDENTIFY DEVICE; false when there is no ATA disk
+        bool Identify();
+
+        virtual bool Read(uint64_t sector, uint32_t count, void* buffer);
+        virtual uint64_t SectorCount();
+};
+
+#endif // !__ATA_H
@@ -0,0 +1,15 @@
+#include "blockdevice.h"
+
+
+BlockDevice::BlockDevice()
+{
+}
+
+BlockDevice::~BlockDevice()
+{
+}
+
+uint64_t BlockDevice::SectorCount()
+{
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __BLOCKDEVICE_H
+#define __BLOCKDEVICE_H
+
+#include "types.h"
+
+#define BLOCK_SECTOR_SIZE 512
+
+// Sector-addressed storage. Read() is one request to the device however
+// many sectors it covers; drivers split it only where the hardware forces
+// them to.
+class BlockDevice {
+    public:
+        BlockDevice();
+        ~BlockDevice();
+
+        virtual bool Read(uint64_t sector, uint32_t count, void* buffer) = 0;
+        virtual uint64_t SectorCount();
+};
+
+#endif // !__BLOCKDEVICE_H
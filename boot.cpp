@@ -0,0 +1,53 @@
+#include "boot.h"
+#include "cpu.h"
+
+uint64_t loaderTimestamp;
+uint64_t constructorsTimestamp;
+
+
+BootTimeline::BootTimeline()
+{
+    count = 0;
+}
+
+BootTimeline::~BootTimeline()
+{
+}
+
+void BootTimeline::Checkpoint(const char* name)
+{
+    Checkpoint(name, readTimestampCounter());
+}
+
+void BootTimeline::Checkpoint(const char* name, uint64_t timestamp)
+{
+    if(count == BOOT_MAX_CHECKPOINTS)
+        return;
+    names[count] = name;
+    timestamps[count] = timestamp;
+    count++;
+}
+
+uint32_t BootTimeline::Count()
+{
+    return count;
+}
+
+const char* BootTimeline::Name(uint32_t n)
+{
+    return n < count ? names[n] : 0;
+}
+
+uint32_t BootTimeline::Microseconds(uint32_t n, uint32_t tscKhz)
+{
+    if(n >= count || tscKhz == 0)
+        return 0;
+    return divide((timestamps[n] - timestamps[0]) * 1000, tscKhz);
+}
+
+uint32_t BootTimeline::StageMicroseconds(uint32_t n, uint32_t tscKhz)
+{
+    if(n == 0 || n >= count || tscKhz == 0)
+        return 0;
+    return divide((timestamps[n] - timestamps[n-1]) * 1000, tscKhz);
+}
@@ -0,0 +1,36 @@
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#include "types.h"
+
+#define BOOT_MAX_CHECKPOINTS 16
+
+// TSC values taken by loader.s on entry and by callConstructors() when it
+// is done, before anything else in the kernel runs
+extern "C" uint64_t loaderTimestamp;
+extern "C" uint64_t constructorsTimestamp;
+
+
+// Named TSC checkpoints along the boot path, reported relative to the
+// first one once the clock has been calibrated.
+class BootTimeline {
+    const char* names[BOOT_MAX_CHECKPOINTS];
+    uint64_t timestamps[BOOT_MAX_CHECKPOINTS];
+    uint32_t count;
+
+    public:
+        BootTimeline();
+        ~BootTimeline();
+
+        void Checkpoint(const char* name);
+        void Checkpoint(const char* name, uint64_t timestamp);
+
+        uint32_t Count();
+        const char* Name(uint32_t n);
+        // Time from the first checkpoint to checkpoint n
+        uint32_t Microseconds(uint32_t n, uint32_t tscKhz);
+        // Time from the previous checkpoint to checkpoint n
+        uint32_t StageMicroseconds(uint32_t n, uint32_t tscKhz);
+};
+
+#endif // !__BOOT_H
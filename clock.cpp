@@ -0,0 +1,144 @@
+#include "clock.h"
+#include "cpu.h"
+
+#define PIT_HZ 1193182
+#define NS_SHIFT 22
+
+// PIT counts per wheel tick: 2^20 ns * 1.193182 MHz
+#define PIT_COUNTS_PER_TICK 1251
+
+// Shortest window the TSC is measured over
+#define CALIBRATION_MS 10
+#define CALIBRATION_COUNTS (PIT_HZ * CALIBRATION_MS / 1000)
+
+// Port reads take about a microsecond, so this gives up after roughly a
+// second on hardware whose OUT2 never rises, and assumes a 1 GHz TSC
+#define CALIBRATION_MAX_POLLS 1000000
+#define CALIBRATION_FALLBACK_KHZ 1000000
+
+
+ClockDriver::ClockDriver(InterruptManager* manager)
+:   InterruptHandler(0x20, manager),
+    pitChannel0(0x40),
+    pitChannel2(0x42),
+    pitCommand(0x43),
+    speakerPort(0x61),
+    wheel(0)
+{
+    tscBase = 0;
+    calibrationStart = 0;
+    calibrating = false;
+    tscKhz = 0;
+    nsPerCycle = 0;
+}
+
+ClockDriver::~ClockDriver() {
+}
+
+void ClockDriver::StartCalibration() {
+    // Gate PIT channel 2 on with the speaker off and let it count down
+    // from 0xFFFF (~55 ms); OUT2 (bit 5 of port 0x61) goes high at zero.
+    speakerPort.Write((speakerPort.Read() & ~0x02) | 0x01);
+    pitCommand.Write(0xB0); // channel 2, lobyte/hibyte, mode 0
+    pitChannel2.Write(0xFF);
+    pitChannel2.Write(0xFF);
+    calibrationStart = readTimestampCounter();
+    calibrating = true;
+}
+
+void ClockDriver::FinishCalibration() {
+    // Whatever ran since StartCalibration() counts towards the window, so
+    // this only spins for the part of CALIBRATION_MS that is left.
+    tscKhz = CALIBRATION_FALLBACK_KHZ;
+    for(uint32_t polls = 0; polls < CALIBRATION_MAX_POLLS; polls++)
+    {
+        pitCommand.Write(0x80); // latch channel 2
+        uint64_t now = readTimestampCounter();
+        uint16_t count = pitChannel2.Read();
+        count |= pitChannel2.Read() << 8;
+
+        if(speakerPort.Read() & 0x20)
+        {
+            // Boot took longer than one countdown, measure afresh
+            StartCalibration();
+            continue;
+        }
+
+        uint32_t elapsed = 0xFFFF - count;
+        if(elapsed >= CALIBRATION_COUNTS)
+        {
+            uint32_t khz = divide((now - calibrationStart) * PIT_HZ, elapsed * 1000);
+            if(khz != 0)
+                tscKhz = khz;
+            break;
+        }
+    }
+    nsPerCycle = divide(1000000ULL << NS_SHIFT, tscKhz);
+    calibrating = false;
+}
+
+void ClockDriver::Activate() {
+    if(!calibrating)
+        StartCalibration();
+    FinishCalibration();
+    tscBase = readTimestampCounter();
+
+    // Channel 0 to one-shot mode. Until a count is written it stays
+    // silent, which stops the BIOS' 18.2 Hz periodic tick.
+    pitCommand.Write(0x30);
+}
+
+uint64_t ClockDriver::Nanoseconds() {
+    uint64_t cycles = readTimestampCounter() - tscBase;
+    uint32_t lo = cycles;
+    uint32_t hi = cycles >> 32;
+    return (((uint64_t)hi * nsPerCycle) << (32 - NS_SHIFT))
+         + (((uint64_t)lo * nsPerCycle) >> NS_SHIFT);
+}
+
+uint64_t ClockDriver::Ticks() {
+    return Nanoseconds() >> CLOCK_TICK_SHIFT;
+}
+
+uint32_t ClockDriver::TscKhz() {
+    return tscKhz;
+}
+
+void ClockDriver::Reprogram() {
+    uint64_t next;
+    if(!wheel.NextExpiry(&next))
+        return; // nothing armed, the previous one-shot simply runs out
+
+    uint64_t now = Ticks();
+    uint32_t count = PIT_COUNTS_PER_TICK;
+    if(next > now + 1)
+        count = (next - now > 0xFFFF / PIT_COUNTS_PER_TICK)
+            ? 0xFFFF
+            : (uint32_t)(next - now) * PIT_COUNTS_PER_TICK;
+
+    pitCommand.Write(0x30); // channel 0, lobyte/hibyte, mode 0 (one-shot)
+    pitChannel0.Write(count & 0xFF);
+    pitChannel0.Write(count >> 8);
+}
+
+void ClockDriver::Arm(Timer* timer, uint64_t delayNanoseconds) {
+    uint64_t delay = (delayNanoseconds + (1 << CLOCK_TICK_SHIFT) - 1) >> CLOCK_TICK_SHIFT;
+
+    uint32_t flags = disableInterrupts();
+    wheel.Advance(Ticks());
+    wheel.Add(timer, Ticks() + delay);
+    Reprogram();
+    restoreInterrupts(flags);
+}
+
+void ClockDriver::Cancel(Timer* timer) {
+    uint32_t flags = disableInterrupts();
+    wheel.Cancel(timer);
+    restoreInterrupts(flags);
+}
+
+uint32_t ClockDriver::HandleInterrupt(uint32_t esp) {
+    wheel.Advance(Ticks());
+    Reprogram();
+    return esp;
+}
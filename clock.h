@@ -0,0 +1,50 @@
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include "types.h"
+#include "interrupts.h"
+#include "port.h"
+#include "timer.h"
+
+// One wheel tick is 2^20 ns (~1.05 ms), so ns -> ticks is a shift
+#define CLOCK_TICK_SHIFT 20
+
+// Monotonic time from the TSC, calibrated against the PIT, plus a
+// tickless timer service: the PIT is run in one-shot mode and programmed
+// for the next timer expiry only, so an idle kernel gets no interrupts.
+// OnExpire() callbacks run in interrupt context.
+class ClockDriver : public InterruptHandler {
+    Port8Bit pitChannel0;
+    Port8Bit pitChannel2;
+    Port8Bit pitCommand;
+    Port8Bit speakerPort;
+
+    uint64_t tscBase;
+    uint64_t calibrationStart;
+    bool calibrating;
+    uint32_t tscKhz;
+    uint32_t nsPerCycle; // fixed point, NS_SHIFT fractional bits
+
+    TimerWheel wheel;
+
+    void FinishCalibration();
+    void Reprogram();
+
+    public:
+        ClockDriver(InterruptManager* manager);
+        ~ClockDriver();
+        virtual uint32_t HandleInterrupt(uint32_t esp);
+        // Starts measuring the TSC against the PIT so that other boot
+        // work overlaps the calibration; Activate() completes it.
+        void StartCalibration();
+        virtual void Activate();
+
+        uint64_t Nanoseconds(); // since Activate()
+        uint64_t Ticks();
+        uint32_t TscKhz();
+
+        void Arm(Timer* timer, uint64_t delayNanoseconds);
+        void Cancel(Timer* timer);
+};
+
+#endif // !__CLOCK_H
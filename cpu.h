@@ -0,0 +1,153 @@
+#ifndef __CPU_H
+#define __CPU_H
+
+#include "types.h"
+
+// Cycle counter, used for timestamps and boot/benchmark measurements
+static inline uint64_t readTimestampCounter() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+
+// FXSAVE/FXRSTOR image, 512 bytes at a 16-byte aligned address
+static inline void saveFpuState(void* area) {
+    asm volatile("fxsave (%0)" : : "r" (area) : "memory");
+}
+
+static inline void restoreFpuState(const void* area) {
+    asm volatile("fxrstor (%0)" : : "r" (area) : "memory");
+}
+
+#ifndef HOST_BUILD
+
+// Returns the previous EFLAGS for restoreInterrupts()
+static inline uint32_t disableInterrupts() {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+static inline void restoreInterrupts(uint32_t flags) {
+    asm volatile("pushl %0; popfl" : : "r" (flags) : "memory", "cc");
+}
+
+static inline void enableInterrupts() {
+    asm volatile("sti" : : : "memory");
+}
+
+// Call with interrupts disabled. sti only takes effect after the next
+// instruction, so an interrupt that arrives after the caller's last check
+// still wakes the hlt. Returns with interrupts disabled again.
+static inline void waitForInterrupt() {
+    asm volatile("sti; hlt; cli" : : : "memory");
+}
+
+static inline uint32_t readCR0() {
+    uint32_t value;
+    asm volatile("mov %%cr0, %0" : "=r" (value));
+    return value;
+}
+
+static inline void writeCR0(uint32_t value) {
+    asm volatile("mov %0, %%cr0" : : "r" (value) : "memory");
+}
+
+// CR0.TS: the next FPU/SSE instruction raises #NM (vector 7)
+static inline void setTaskSwitched() {
+    writeCR0(readCR0() | 0x8);
+}
+
+static inline void clearTaskSwitched() {
+    asm volatile("clts" : : : "memory");
+}
+
+// Linear address of the last page fault
+static inline uint32_t readCR2() {
+    uint32_t value;
+    asm volatile("mov %%cr2, %0" : "=r" (value));
+    return value;
+}
+
+static inline uint32_t readCR4() {
+    uint32_t value;
+    asm volatile("mov %%cr4, %0" : "=r" (value));
+    return value;
+}
+
+static inline void writeCR4(uint32_t value) {
+    asm volatile("mov %0, %%cr4" : : "r" (value) : "memory");
+}
+
+static inline void writeCR3(uint32_t value) {
+    asm volatile("mov %0, %%cr3" : : "r" (value) : "memory");
+}
+
+static inline uint64_t readMSR(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void writeMSR(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)), "c" (msr));
+}
+
+static inline void invalidatePage(uint32_t address) {
+    asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+// 64/32 -> 32 bit division without pulling in libgcc's __udivdi3.
+// The quotient has to fit in 32 bits.
+static inline uint32_t divide(uint64_t dividend, uint32_t divisor) {
+    uint32_t quotient, remainder;
+    asm("divl %4"
+        : "=a" (quotient), "=d" (remainder)
+        : "a" ((uint32_t)dividend), "d" ((uint32_t)(dividend >> 32)), "rm" (divisor));
+    return quotient;
+}
+
+// Reload CS with a far return and the data segment registers after lgdt
+static inline void loadSegments(uint16_t code, uint16_t data) {
+    asm volatile(
+        "pushl %0\n"
+        "pushl $1f\n"
+        "lret\n"
+        "1:\n"
+        "mov %1, %%ds\n"
+        "mov %1, %%es\n"
+        "mov %1, %%fs\n"
+        "mov %1, %%gs\n"
+        "mov %1, %%ss\n"
+        : : "r" ((uint32_t)code), "r" ((uint32_t)data) : "memory");
+}
+
+#else
+
+// Host builds (make host-test) run in user mode with nothing to mask
+static inline uint32_t disableInterrupts() { return 0; }
+static inline void restoreInterrupts(uint32_t) {}
+static inline void enableInterrupts() {}
+static inline void waitForInterrupt() {}
+static inline void loadSegments(uint16_t, uint16_t) {}
+static inline uint32_t divide(uint64_t dividend, uint32_t divisor) { return dividend / divisor; }
+static inline void setTaskSwitched() {}
+static inline void clearTaskSwitched() {}
+// Page table code is exercised on the host without ever being loaded
+static inline uint32_t readCR0() { return 0; }
+static inline void writeCR0(uint32_t) {}
+static inline uint32_t readCR2() { return 0; }
+static inline uint32_t readCR4() { return 0; }
+static inline void writeCR4(uint32_t) {}
+static inline void writeCR3(uint32_t) {}
+static inline uint64_t readMSR(uint32_t) { return 0; }
+static inline void writeMSR(uint32_t, uint64_t) {}
+static inline void invalidatePage(uint32_t) {}
+
+#endif
+
+#endif // __CPU_H
@@ -0,0 +1,472 @@
+#include "fat32.h"
+
+#define FAT_ENTRY_MASK    0x0FFFFFFF
+#define FAT_END_OF_CHAIN  0x0FFFFFF8
+#define FAT_NO_SECTOR     0xFFFFFFFFFFFFFFFFULL
+
+#define DIRECTORY_ENTRY_SIZE 32
+#define LONG_NAME_CHARACTERS 13
+#define LONG_NAME_MAX_ENTRIES 20
+
+static uint16_t read16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t read32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static char toLower(char c)
+{
+    return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// a is nul-terminated, b has the given length
+static bool namesEqual(const char* a, const char* b, uint32_t length)
+{
+    for(uint32_t i = 0; i < length; i++)
+        if(a[i] == '\0' || toLower(a[i]) != toLower(b[i]))
+            return false;
+    return a[length] == '\0';
+}
+
+// Offsets of the 13 UCS-2 characters in a long name entry
+static const uint8_t longNameOffsets[LONG_NAME_CHARACTERS] = {
+    1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30
+};
+
+static uint8_t shortNameChecksum(const uint8_t* entry)
+{
+    uint8_t sum = 0;
+    for(int i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + entry[i];
+    return sum;
+}
+
+// "README  TXT" -> "README.TXT", honouring the NT lower case flags
+static void formatShortName(const uint8_t* entry, char* name)
+{
+    bool lowerBase = entry[12] & 0x08;
+    bool lowerExtension = entry[12] & 0x10;
+    uint32_t length = 0;
+    for(int i = 0; i < 8 && entry[i] != ' '; i++)
+    {
+        char c = (i == 0 && entry[i] == 0x05) ? (char)0xE5 : entry[i];
+        name[length++] = lowerBase ? toLower(c) : c;
+    }
+    if(entry[8] != ' ')
+    {
+        name[length++] = '.';
+        for(int i = 8; i < 11 && entry[i] != ' '; i++)
+            name[length++] = lowerExtension ? toLower(entry[i]) : entry[i];
+    }
+    name[length] = '\0';
+}
+
+
+FatFile::FatFile()
+{
+    fileSystem = 0;
+    extentCount = 0;
+    size = 0;
+    position = 0;
+    directory = false;
+    cachedSector = FAT_NO_SECTOR;
+}
+
+FatFile::~FatFile()
+{
+}
+
+uint32_t FatFile::Size()
+{
+    return size;
+}
+
+uint32_t FatFile::Position()
+{
+    return position;
+}
+
+bool FatFile::Seek(uint32_t position)
+{
+    if(position > size)
+        return false;
+    this->position = position;
+    return true;
+}
+
+bool FatFile::IsDirectory()
+{
+    return directory;
+}
+
+uint32_t FatFile::ExtentCount()
+{
+    return extentCount;
+}
+
+// Binary search for the extent holding the file's n-th cluster
+FatExtent* FatFile::FindExtent(uint32_t fileCluster)
+{
+    if(extentCount == 0)
+        return 0;
+
+    uint32_t low = 0;
+    uint32_t high = extentCount;
+    while(high - low > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+        if(extents[middle].fileCluster <= fileCluster)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    FatExtent* extent = &extents[low];
+    if(fileCluster < extent->fileCluster || fileCluster - extent->fileCluster >= extent->length)
+        return 0;
+    return extent;
+}
+
+bool FatFile::LoadSector(uint64_t number)
+{
+    if(number == cachedSector)
+        return true;
+    if(!fileSystem->device->Read(number, 1, sector))
+    {
+        cachedSector = FAT_NO_SECTOR;
+        return false;
+    }
+    cachedSector = number;
+    return true;
+}
+
+uint32_t FatFile::Read(void* buffer, uint32_t count)
+{
+    if(fileSystem == 0 || position >= size)
+        return 0;
+    if(count > size - position)
+        count = size - position;
+
+    uint8_t* target = (uint8_t*)buffer;
+    uint32_t shift = fileSystem->clusterShift;
+    uint32_t done = 0;
+    while(done < count)
+    {
+        FatExtent* extent = FindExtent(position >> shift);
+        if(extent == 0)
+            break;
+
+        // Everything up to the end of the extent is contiguous on disk
+        uint32_t offset = position - (extent->fileCluster << shift);
+        uint64_t run = ((uint64_t)extent->length << shift) - offset;
+        if(run > count - done)
+            run = count - done;
+        uint64_t number = fileSystem->ClusterSector(extent->cluster) + offset / BLOCK_SECTOR_SIZE;
+
+        uint32_t n;
+        uint32_t sectorOffset = position % BLOCK_SECTOR_SIZE;
+        if(sectorOffset != 0 || run < BLOCK_SECTOR_SIZE)
+        {
+            if(!LoadSector(number))
+                break;
+            n = BLOCK_SECTOR_SIZE - sectorOffset;
+            if(n > run)
+                n = run;
+            for(uint32_t i = 0; i < n; i++)
+                target[done + i] = sector[sectorOffset + i];
+        }
+        else
+        {
+            // All whole sectors of the run, however many clusters they
+            // span, in one request straight into the caller's buffer
+            uint32_t sectors = run / BLOCK_SECTOR_SIZE;
+            if(!fileSystem->device->Read(number, sectors, target + done))
+                break;
+            n = sectors * BLOCK_SECTOR_SIZE;
+        }
+
+        position += n;
+        done += n;
+    }
+    return done;
+}
+
+
+FatFileSystem::FatFileSystem(BlockDevice* device, uint32_t* fatCache, uint32_t fatCacheEntries)
+{
+    this->device = device;
+    fat = fatCache;
+    fatCapacity = fatCacheEntries;
+    fatStart = 0;
+    dataStart = 0;
+    sectorsPerCluster = 0;
+    clusterShift = 0;
+    clusterCount = 0;
+    rootCluster = 0;
+    mounted = false;
+}
+
+FatFileSystem::~FatFileSystem()
+{
+}
+
+bool FatFileSystem::Mount()
+{
+    uint8_t bootSector[BLOCK_SECTOR_SIZE];
+    if(!device->Read(0, 1, bootSector) || read16(bootSector + 510) != 0xAA55)
+        return false;
+    if(MountVolume(0, bootSector))
+        return true;
+
+    // Not a volume by itself: try the FAT32 partitions of the MBR
+    for(int i = 0; i < 4; i++)
+    {
+        const uint8_t* partition = bootSector + 446 + 16*i;
+        if(partition[4] != 0x0B && partition[4] != 0x0C)
+            continue;
+        uint32_t start = read32(partition + 8);
+        uint8_t volumeSector[BLOCK_SECTOR_SIZE];
+        if(device->Read(start, 1, volumeSector)
+        && read16(volumeSector + 510) == 0xAA55
+        && MountVolume(start, volumeSector))
+            return true;
+    }
+    return false;
+}
+
+bool FatFileSystem::MountVolume(uint64_t start, const uint8_t* bootSector)
+{
+    uint16_t bytesPerSector = read16(bootSector + 11);
+    uint8_t clusterSectors = bootSector[13];
+    uint16_t reservedSectors = read16(bootSector + 14);
+    uint8_t fatCount = bootSector[16];
+    uint16_t rootEntries = read16(bootSector + 17);
+    uint32_t totalSectors = read16(bootSector + 19) != 0 ? read16(bootSector + 19) : read32(bootSector + 32);
+    uint16_t fatSize16 = read16(bootSector + 22);
+    uint32_t fatSize = read32(bootSector + 36);
+    uint16_t extendedFlags = read16(bootSector + 40);
+
+    // FAT32 is recognised by its BPB layout (no fixed root directory, a
+    // 32-bit FAT size) rather than by cluster count, so small images work
+    if(bytesPerSector != BLOCK_SECTOR_SIZE
+    || clusterSectors == 0 || (clusterSectors & (clusterSectors - 1)) != 0
+    || reservedSectors == 0 || fatCount == 0
+    || rootEntries != 0 || fatSize16 != 0 || fatSize == 0)
+        return false;
+
+    // With mirroring off (bit 7) only the FAT numbered in bits 0-3 is
+    // kept up to date, otherwise all copies are and the first one will do
+    uint32_t activeFat = (extendedFlags & 0x80) ? (extendedFlags & 0x0F) : 0;
+    if(activeFat >= fatCount)
+        return false;
+
+    uint32_t dataOffset = reservedSectors + fatCount * fatSize;
+    if(totalSectors <= dataOffset)
+        return false;
+    uint32_t clusters = (totalSectors - dataOffset) / clusterSectors;
+    uint32_t entries = clusters + 2;
+    uint32_t sectors = (entries * 4 + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    if(sectors > fatSize || sectors * (BLOCK_SECTOR_SIZE / 4) > fatCapacity)
+        return false;
+
+    uint32_t root = read32(bootSector + 44);
+    if(root < 2 || root >= entries)
+        return false;
+
+    // The whole FAT in one request; chains are only ever walked in memory
+    uint64_t activeStart = start + reservedSectors + activeFat * fatSize;
+    if(!device->Read(activeStart, sectors, fat))
+        return false;
+
+    fatStart = activeStart;
+    dataStart = start + dataOffset;
+    sectorsPerCluster = clusterSectors;
+    clusterShift = 9;
+    while((1u << clusterShift) < BLOCK_SECTOR_SIZE * clusterSectors)
+        clusterShift++;
+    clusterCount = clusters;
+    rootCluster = root;
+    mounted = true;
+    return true;
+}
+
+uint32_t FatFileSystem::ClusterSize()
+{
+    return sectorsPerCluster * BLOCK_SECTOR_SIZE;
+}
+
+uint32_t FatFileSystem::ClusterCount()
+{
+    return clusterCount;
+}
+
+BlockDevice* FatFileSystem::Device()
+{
+    return device;
+}
+
+uint64_t FatFileSystem::ClusterSector(uint32_t cluster)
+{
+    return dataStart + (uint64_t)(cluster - 2) * sectorsPerCluster;
+}
+
+bool FatFileSystem::OpenCluster(uint32_t cluster, uint32_t size, bool directory, FatFile* file)
+{
+    file->fileSystem = this;
+    file->extentCount = 0;
+    file->position = 0;
+    file->directory = directory;
+    file->cachedSector = FAT_NO_SECTOR;
+
+    // Walk the chain once, merging consecutive clusters into extents
+    uint32_t clusters = 0;
+    uint32_t next = cluster;
+    while(next >= 2 && next < clusterCount + 2)
+    {
+        FatExtent* last = file->extentCount != 0 ? &file->extents[file->extentCount - 1] : 0;
+        if(last != 0 && last->cluster + last->length == next)
+        {
+            last->length++;
+        }
+        else
+        {
+            if(file->extentCount == FAT32_MAX_EXTENTS)
+                return false;
+            FatExtent* extent = &file->extents[file->extentCount++];
+            extent->fileCluster = clusters;
+            extent->cluster = next;
+            extent->length = 1;
+        }
+
+        if(++clusters > clusterCount)
+            return false; // the chain loops
+        next = fat[next] & FAT_ENTRY_MASK;
+    }
+    if(cluster != 0 && next < FAT_END_OF_CHAIN)
+        return false; // runs into a free, bad or out of range cluster
+
+    uint64_t capacity = (uint64_t)clusters << clusterShift;
+    if(directory)
+        size = capacity > 0xFFFFFFFF ? 0xFFFFFFFF : capacity;
+    if(size > capacity)
+        return false;
+    file->size = size;
+    return true;
+}
+
+bool FatFileSystem::Open(const char* path, FatFile* file)
+{
+    if(!mounted || !OpenCluster(rootCluster, 0, true, file))
+        return false;
+
+    while(*path == '/')
+        path++;
+    while(*path != '\0')
+    {
+        const char* name = path;
+        uint32_t length = 0;
+        while(name[length] != '\0' && name[length] != '/')
+            length++;
+        path += length;
+        while(*path == '/')
+            path++;
+
+        if(!file->directory)
+            return false;
+
+        FatDirectoryEntry entry;
+        bool found = false;
+        while(!found && ReadDirectory(file, &entry))
+            found = namesEqual(entry.name, name, length);
+        if(!found)
+            return false;
+
+        bool directory = entry.attributes & FAT_ATTRIBUTE_DIRECTORY;
+        uint32_t cluster = entry.cluster;
+        if(directory && cluster == 0)
+            cluster = rootCluster; // ".." of a top level directory
+        if(!OpenCluster(cluster, entry.size, directory, file))
+            return false;
+    }
+    return true;
+}
+
+bool FatFileSystem::ReadDirectory(FatFile* directory, FatDirectoryEntry* entry)
+{
+    if(!directory->directory)
+        return false;
+
+    // Long name entries come before their short entry, last part first
+    bool longName = false;
+    uint8_t checksum = 0;
+    uint8_t ordinal = 0;
+
+    uint8_t raw[DIRECTORY_ENTRY_SIZE];
+    while(directory->Read(raw, DIRECTORY_ENTRY_SIZE) == DIRECTORY_ENTRY_SIZE)
+    {
+        if(raw[0] == 0x00)
+        {
+            // End of directory; stay here so further calls also stop
+            directory->position -= DIRECTORY_ENTRY_SIZE;
+            return false;
+        }
+        if(raw[0] == 0xE5)
+        {
+            longName = false;
+            continue;
+        }
+
+        uint8_t attributes = raw[11];
+        if((attributes & 0x3F) == FAT_ATTRIBUTE_LONG_NAME)
+        {
+            uint8_t n = raw[0] & 0x1F;
+            if(raw[0] & 0x40)
+            {
+                longName = 0 < n && n <= LONG_NAME_MAX_ENTRIES;
+                checksum = raw[13];
+                uint32_t end = n * LONG_NAME_CHARACTERS;
+                entry->name[end < FAT32_MAX_NAME ? end : FAT32_MAX_NAME] = '\0';
+            }
+            else if(!longName || n != ordinal - 1 || raw[13] != checksum)
+            {
+                longName = false;
+            }
+            ordinal = n;
+            if(!longName)
+                continue;
+
+            for(uint32_t i = 0; i < LONG_NAME_CHARACTERS; i++)
+            {
+                uint32_t index = (n - 1) * LONG_NAME_CHARACTERS + i;
+                uint16_t c = read16(raw + longNameOffsets[i]);
+                if(index >= FAT32_MAX_NAME)
+                    break;
+                if(c == 0x0000)
+                {
+                    entry->name[index] = '\0';
+                    break;
+                }
+                entry->name[index] = c < 0x80 ? (char)c : '?';
+            }
+            continue;
+        }
+
+        if(attributes & FAT_ATTRIBUTE_VOLUME_ID)
+        {
+            longName = false;
+            continue;
+        }
+
+        if(!longName || ordinal != 1 || shortNameChecksum(raw) != checksum)
+            formatShortName(raw, entry->name);
+        entry->attributes = attributes;
+        entry->cluster = ((uint32_t)read16(raw + 20) << 16) | read16(raw + 26);
+        entry->size = read32(raw + 28);
+        return true;
+    }
+    return false;
+}
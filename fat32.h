@@ -0,0 +1,109 @@
+#ifndef __FAT32_H
+#define __FAT32_H
+
+#include "types.h"
+#include "blockdevice.h"
+
+#define FAT32_MAX_EXTENTS 256
+#define FAT32_MAX_NAME 255
+
+#define FAT_ATTRIBUTE_READ_ONLY 0x01
+#define FAT_ATTRIBUTE_HIDDEN    0x02
+#define FAT_ATTRIBUTE_SYSTEM    0x04
+#define FAT_ATTRIBUTE_VOLUME_ID 0x08
+#define FAT_ATTRIBUTE_DIRECTORY 0x10
+#define FAT_ATTRIBUTE_ARCHIVE   0x20
+#define FAT_ATTRIBUTE_LONG_NAME 0x0F
+
+class FatFileSystem;
+
+// A run of physically consecutive clusters in a file's chain
+struct FatExtent {
+    uint32_t fileCluster; // index of the first cluster within the file
+    uint32_t cluster;     // first cluster on disk
+    uint32_t length;      // in clusters
+};
+
+struct FatDirectoryEntry {
+    char name[FAT32_MAX_NAME + 1]; // long name if present, else 8.3
+    uint32_t cluster;
+    uint32_t size;
+    uint8_t attributes;
+};
+
+
+// An open file or directory. The cluster chain is turned into extents
+// when it is opened, so a seek is a binary search over the extents and
+// never walks the FAT again.
+class FatFile {
+    friend class FatFileSystem;
+
+    FatFileSystem* fileSystem;
+    FatExtent extents[FAT32_MAX_EXTENTS];
+    uint32_t extentCount;
+    uint32_t size;
+    uint32_t position;
+    bool directory;
+
+    // Last partially read sector, so small sequential reads such as
+    // directory entries don't each go to the device
+    uint8_t sector[BLOCK_SECTOR_SIZE];
+    uint64_t cachedSector;
+
+    FatExtent* FindExtent(uint32_t fileCluster);
+    bool LoadSector(uint64_t number);
+
+    public:
+        FatFile();
+        ~FatFile();
+
+        uint32_t Size();
+        uint32_t Position();
+        bool Seek(uint32_t position);
+        // Returns the number of bytes read, short at the end of the file
+        uint32_t Read(void* buffer, uint32_t count);
+
+        bool IsDirectory();
+        uint32_t ExtentCount();
+};
+
+
+// Read-only FAT32 on a BlockDevice, either the whole device or the first
+// FAT32 partition of an MBR. The caller provides memory for the FAT, which
+// is read in full by Mount().
+class FatFileSystem {
+    friend class FatFile;
+
+    BlockDevice* device;
+    uint32_t* fat;
+    uint32_t fatCapacity; // entries
+
+    uint64_t fatStart;    // sectors
+    uint64_t dataStart;
+    uint32_t sectorsPerCluster;
+    uint32_t clusterShift; // log2 of the cluster size in bytes
+    uint32_t clusterCount;
+    uint32_t rootCluster;
+    bool mounted;
+
+    bool MountVolume(uint64_t start, const uint8_t* bootSector);
+    bool OpenCluster(uint32_t cluster, uint32_t size, bool directory, FatFile* file);
+
+    public:
+        FatFileSystem(BlockDevice* device, uint32_t* fatCache, uint32_t fatCacheEntries);
+        ~FatFileSystem();
+
+        bool Mount();
+        uint32_t ClusterSize();
+        uint32_t ClusterCount();
+
+        // Absolute path with '/' separators, names compared ignoring case
+        bool Open(const char* path, FatFile* file);
+        // Next entry of an open directory, false at its end
+        bool ReadDirectory(FatFile* directory, FatDirectoryEntry* entry);
+
+        BlockDevice* Device();
+        uint64_t ClusterSector(uint32_t cluster);
+};
+
+#endif // !__FAT32_H
@@ -0,0 +1,11 @@
+#ifndef __FONT_H
+#define __FONT_H
+
+#include "types.h"
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 8
+
+extern const uint8_t font8x8[128][8];
+
+#endif // __FONT_H
@@ -0,0 +1,164 @@
+#include "fpu.h"
+#include "cpu.h"
+
+#define CR0_MP 0x02
+#define CR0_EM 0x04
+#define CR0_NE 0x20
+#define CR4_OSFXSR 0x200
+#define CR4_OSXMMEXCPT 0x400
+
+// FXSAVE image offsets
+#define FXSAVE_MXCSR 24
+#define FXSAVE_XMM 160
+#define FXSAVE_XMM_END 416
+
+// What a fresh context starts from: fninit defaults, exceptions masked,
+// all XMM registers zero
+static FpuContext initialState;
+
+FloatingPointUnit* FloatingPointUnit::ActiveFloatingPointUnit = 0;
+
+FloatingPointUnit::FloatingPointUnit(InterruptManager* manager)
+: InterruptHandler(0x07, manager)
+{
+    current = 0;
+    owner = 0;
+    simd = false;
+    kernelSection = false;
+    saves = 0;
+    restores = 0;
+}
+
+FloatingPointUnit::~FloatingPointUnit()
+{
+    if(ActiveFloatingPointUnit == this)
+        ActiveFloatingPointUnit = 0;
+}
+
+void FloatingPointUnit::Activate(FpuContext* initial)
+{
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    bool fxsr = d & (1 << 24);
+    simd = fxsr && (d & (1 << 25)) && (d & (1 << 26)); // SSE and SSE2
+    if(!fxsr)
+        return;
+
+    writeCR0((readCR0() & ~CR0_EM) | CR0_MP | CR0_NE);
+    writeCR4(readCR4() | CR4_OSFXSR | (simd ? CR4_OSXMMEXCPT : 0));
+    clearTaskSwitched();
+
+    asm volatile("fninit");
+    saveFpuState(initialState.state);
+    uint32_t* mxcsr = (uint32_t*)(initialState.state + FXSAVE_MXCSR);
+    *mxcsr = 0x1F80; // fninit leaves MXCSR alone
+    for(uint32_t i = FXSAVE_XMM; i < FXSAVE_XMM_END; i++)
+        initialState.state[i] = 0;
+    initialState.initialized = true;
+
+    current = initial;
+    owner = 0;
+    ActiveFloatingPointUnit = this;
+    setTaskSwitched();
+}
+
+bool FloatingPointUnit::SimdSupported()
+{
+    return simd;
+}
+
+void FloatingPointUnit::SwitchTo(FpuContext* context)
+{
+    uint32_t flags = disableInterrupts();
+    current = context;
+    if(owner == current)
+        clearTaskSwitched();
+    else
+        setTaskSwitched();
+    restoreInterrupts(flags);
+}
+
+FpuContext* FloatingPointUnit::Current()
+{
+    return current;
+}
+
+FpuContext* FloatingPointUnit::Owner()
+{
+    return owner;
+}
+
+uint32_t FloatingPointUnit::Saves()
+{
+    return saves;
+}
+
+uint32_t FloatingPointUnit::Restores()
+{
+    return restores;
+}
+
+// #NM: the current context used the FPU while CR0.TS was set
+uint32_t FloatingPointUnit::HandleInterrupt(uint32_t esp)
+{
+    clearTaskSwitched();
+    // Inside a kernel section the registers are its scratch, whoever set
+    // TS in between (a SwitchTo() from an interrupt handler)
+    if(kernelSection || owner == current || current == 0)
+        return esp;
+
+    if(owner != 0)
+    {
+        saveFpuState(owner->state);
+        saves++;
+    }
+    if(!current->initialized)
+    {
+        restoreFpuState(initialState.state);
+        current->initialized = true;
+    }
+    else
+    {
+        restoreFpuState(current->state);
+        restores++;
+    }
+    owner = current;
+    return esp;
+}
+
+bool FloatingPointUnit::Begin()
+{
+    FloatingPointUnit* fpu = ActiveFloatingPointUnit;
+    if(fpu == 0 || !fpu->simd)
+        return false;
+
+    // Only the handover is atomic; the section itself runs with interrupts
+    // enabled, so a long Flush() doesn't hold up the timer and input IRQs
+    uint32_t flags = disableInterrupts();
+    if(fpu->kernelSection)
+    {
+        restoreInterrupts(flags);
+        return false;
+    }
+    fpu->kernelSection = true;
+    clearTaskSwitched();
+    if(fpu->owner != 0)
+    {
+        saveFpuState(fpu->owner->state);
+        fpu->saves++;
+        fpu->owner = 0;
+    }
+    restoreInterrupts(flags);
+    return true;
+}
+
+void FloatingPointUnit::End()
+{
+    FloatingPointUnit* fpu = ActiveFloatingPointUnit;
+    uint32_t flags = disableInterrupts();
+    fpu->kernelSection = false;
+    // The registers now hold kernel scratch; whoever uses them next
+    // traps and reloads its own state
+    setTaskSwitched();
+    restoreInterrupts(flags);
+}
@@ -0,0 +1,53 @@
+#ifndef __FPU_H
+#define __FPU_H
+
+#include "types.h"
+#include "interrupts.h"
+
+#define FPU_STATE_SIZE 512
+
+// x87/MMX/SSE register state of one execution context, in FXSAVE layout
+struct FpuContext {
+    uint8_t state[FPU_STATE_SIZE];
+    bool initialized;
+} __attribute__((aligned(16)));
+
+
+// Lazy FPU/SSE context switching. SwitchTo() only sets CR0.TS; the
+// registers are saved and reloaded by the #NM handler when the new context
+// actually touches them. Kernel code that wants SIMD brackets it with
+// Begin()/End(); interrupts stay enabled inside, and the registers go back
+// to their owner lazily afterwards.
+class FloatingPointUnit : public InterruptHandler {
+    FpuContext* current; // context the running code belongs to
+    FpuContext* owner;   // context whose state is in the registers, or 0
+    bool simd;
+
+    bool kernelSection; // the registers hold Begin()/End() scratch
+
+    uint32_t saves;
+    uint32_t restores;
+
+    public:
+        static FloatingPointUnit* ActiveFloatingPointUnit;
+
+        FloatingPointUnit(InterruptManager* manager);
+        ~FloatingPointUnit();
+        virtual uint32_t HandleInterrupt(uint32_t esp);
+        void Activate(FpuContext* initial);
+
+        bool SimdSupported();
+        void SwitchTo(FpuContext* context);
+        FpuContext* Current();
+        FpuContext* Owner();
+        uint32_t Saves();
+        uint32_t Restores();
+
+        // Returns false when SSE is unavailable, or a section is already
+        // running (an interrupt handler nested inside one), and the caller
+        // must use its scalar path. End() only follows a successful Begin().
+        static bool Begin();
+        static void End();
+};
+
+#endif // !__FPU_H
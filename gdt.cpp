@@ -45,18 +45,22 @@
 #include "types.h"
 #include "interrupts.h"
 #include "port.h"
+#include "cpu.h"
 
 
 GlobalDescriptorTable::GlobalDescriptorTable()
     : nullSegmentSelector(0, 0 ,0), // Base, Limit, Flags
       unusedSegmentSelector(0, 0, 0), // Base, Limit, Flags
-      codeSegmentSelector(0, 64*1024*1024, 0x9A), // Base, Limit, Code Segment Flags (0x9A)
-      dataSegmentSelector(0, 64*1024*1024, 0x92) // Base, Limit, Data Segment Flags (0x92)
+      codeSegmentSelector(0, 0xFFFFFFFF, 0x9A), // Base, Limit (flat 4 GiB), Code Segment Flags (0x9A)
+      dataSegmentSelector(0, 0xFFFFFFFF, 0x92) // Base, Limit (flat 4 GiB), Data Segment Flags (0x92)
 {
     uint32_t i[2];
-    i[1] = (uint32_t)this; // first byte for address of table itself
+    i[1] = (uint32_t)(size_t)this; // first byte for address of table itself
     i[0] = sizeof(GlobalDescriptorTable) << 16; // fisrt 4 bytes are high byte of second integer
-    asm volatile("lgdt (%0)": :"p" (((uint8_t *) i)+2));
+    asm volatile("lgdt (%0)": :"r" (((uint8_t *) i)+2));
+
+    // The old descriptors stay cached in the segment registers until reloaded
+    loadSegments(CodeSegmentSelector(), DataSegmentSelector());
 
     /*
     GDTR structure: [limit (16 bits) | base (32 bits)] (total 6 bytes)
@@ -0,0 +1,374 @@
+#include "graphics.h"
+#include "font.h"
+#include "fpu.h"
+
+
+// rep stos/movs: on current CPUs the microcode moves whole cache lines
+// per iteration, which beats any 32-bit store loop we can write by hand.
+void fillPixels(uint32_t* target, uint32_t color, uint32_t count)
+{
+    size_t n = count;
+    asm volatile("rep stosl" : "+D" (target), "+c" (n) : "a" (color) : "memory");
+}
+
+void copyPixels(uint32_t* target, const uint32_t* source, uint32_t count)
+{
+    size_t n = count;
+    asm volatile("rep movsl" : "+D" (target), "+S" (source), "+c" (n) : : "memory");
+}
+
+// The kernel is built without SSE, so gcc never allocates XMM registers
+// there and refuses to hear of them in a clobber list
+#ifdef __SSE__
+#define XMM_CLOBBERS , "xmm0", "xmm1", "xmm2", "xmm3"
+#else
+#define XMM_CLOBBERS
+#endif
+
+// Video memory is usually uncached, where rep movs falls back to one bus
+// transaction per dword; movntdq writes 16 bytes at a time and, on normal
+// memory, keeps the copy from evicting the caches.
+void streamPixels(uint32_t* target, const uint32_t* source, uint32_t count)
+{
+    while(count != 0 && ((size_t)target & 15) != 0)
+    {
+        *target++ = *source++;
+        count--;
+    }
+    for(; count >= 16; count -= 16, target += 16, source += 16)
+    {
+        asm volatile(
+            "movdqu (%1), %%xmm0\n"
+            "movdqu 16(%1), %%xmm1\n"
+            "movdqu 32(%1), %%xmm2\n"
+            "movdqu 48(%1), %%xmm3\n"
+            "movntdq %%xmm0, (%0)\n"
+            "movntdq %%xmm1, 16(%0)\n"
+            "movntdq %%xmm2, 32(%0)\n"
+            "movntdq %%xmm3, 48(%0)\n"
+            : : "r" (target), "r" (source) : "memory" XMM_CLOBBERS);
+    }
+    while(count-- != 0)
+        *target++ = *source++;
+    asm volatile("sfence" : : : "memory");
+}
+
+void blendPixels(uint32_t* target, const uint32_t* source, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t s = source[i];
+        uint32_t alpha = s >> 24;
+        if(alpha == 0)
+            continue;
+        if(alpha == 255)
+        {
+            target[i] = s;
+            continue;
+        }
+
+        // Red and blue share one multiply, green gets the other
+        uint32_t d = target[i];
+        uint32_t inverse = 255 - alpha;
+        uint32_t rb = ((s & 0xFF00FF) * alpha + (d & 0xFF00FF) * inverse) >> 8;
+        uint32_t g = ((s & 0x00FF00) * alpha + (d & 0x00FF00) * inverse) >> 8;
+        target[i] = 0xFF000000 | (rb & 0xFF00FF) | (g & 0x00FF00);
+    }
+}
+
+
+static const char* cursorShape[CURSOR_HEIGHT] = {
+    "X           ",
+    "XX          ",
+    "XoX         ",
+    "XooX        ",
+    "XoooX       ",
+    "XooooX      ",
+    "XoooooX     ",
+    "XooooooX    ",
+    "XoooooooX   ",
+    "XooooooooX  ",
+    "XoooooooooX ",
+    "XooooooXXXXX",
+    "XoooXooX    ",
+    "XooXXooX    ",
+    "XoX  XooX   ",
+    "XX   XooX   ",
+    "X     XooX  ",
+    "      XooX  ",
+    "       XX   "
+};
+
+static uint32_t cursorImage[CURSOR_HEIGHT * CURSOR_WIDTH];
+
+
+Framebuffer::Framebuffer(uint32_t* frontBuffer, uint32_t width, uint32_t height, uint32_t pitchBytes, uint32_t* backBuffer)
+{
+    this->frontBuffer = frontBuffer;
+    this->backBuffer = backBuffer;
+    this->width = width;
+    this->height = height;
+    pitch = pitchBytes / 4;
+    damageCount = 0;
+
+    cursorVisible = false;
+    cursor.x = width / 2;
+    cursor.y = height / 2;
+    cursor.width = CURSOR_WIDTH;
+    cursor.height = CURSOR_HEIGHT;
+
+    for(int32_t y = 0; y < CURSOR_HEIGHT; y++)
+        for(int32_t x = 0; x < CURSOR_WIDTH; x++)
+        {
+            char c = cursorShape[y][x];
+            cursorImage[y*CURSOR_WIDTH + x] = c == 'X' ? 0xFF000000 : c == 'o' ? 0xFFFFFFFF : 0;
+        }
+}
+
+Framebuffer::~Framebuffer()
+{
+}
+
+bool Framebuffer::Active()
+{
+    return frontBuffer != 0;
+}
+
+int32_t Framebuffer::Width()
+{
+    return width;
+}
+
+int32_t Framebuffer::Height()
+{
+    return height;
+}
+
+bool Framebuffer::Clip(Rectangle* r)
+{
+    if(r->x < 0) { r->width += r->x; r->x = 0; }
+    if(r->y < 0) { r->height += r->y; r->y = 0; }
+    if(r->x + r->width > width) r->width = width - r->x;
+    if(r->y + r->height > height) r->height = height - r->y;
+    return r->width > 0 && r->height > 0;
+}
+
+static bool touches(const Rectangle& a, const Rectangle& b)
+{
+    return a.x <= b.x + b.width && b.x <= a.x + a.width
+        && a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+static void unite(Rectangle* a, const Rectangle& b)
+{
+    int32_t right = a->x + a->width > b.x + b.width ? a->x + a->width : b.x + b.width;
+    int32_t bottom = a->y + a->height > b.y + b.height ? a->y + a->height : b.y + b.height;
+    if(b.x < a->x) a->x = b.x;
+    if(b.y < a->y) a->y = b.y;
+    a->width = right - a->x;
+    a->height = bottom - a->y;
+}
+
+void Framebuffer::AddDamage(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    Rectangle r = { x, y, width, height };
+    if(!Clip(&r))
+        return;
+
+    // Overlapping or adjacent areas (a run of text cells) become one
+    for(uint32_t i = 0; i < damageCount; )
+    {
+        if(touches(r, damage[i]))
+        {
+            unite(&r, damage[i]);
+            damage[i] = damage[--damageCount];
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if(damageCount == GRAPHICS_MAX_DAMAGE)
+    {
+        for(uint32_t i = 0; i < damageCount; i++)
+            unite(&r, damage[i]);
+        damageCount = 0;
+    }
+
+    damage[damageCount++] = r;
+}
+
+uint32_t Framebuffer::DamageCount()
+{
+    return damageCount;
+}
+
+Rectangle Framebuffer::Damage(uint32_t n)
+{
+    return damage[n];
+}
+
+void Framebuffer::FillRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color)
+{
+    Rectangle r = { x, y, width, height };
+    if(!Clip(&r))
+        return;
+
+    for(int32_t row = r.y; row < r.y + r.height; row++)
+        fillPixels(backBuffer + row*this->width + r.x, color, r.width);
+    AddDamage(r.x, r.y, r.width, r.height);
+}
+
+void Framebuffer::Blit(int32_t x, int32_t y, const uint32_t* source, int32_t width, int32_t height, uint32_t stride)
+{
+    Rectangle r = { x, y, width, height };
+    if(!Clip(&r))
+        return;
+
+    source += (r.y - y)*stride + (r.x - x);
+    for(int32_t row = 0; row < r.height; row++)
+        copyPixels(backBuffer + (r.y + row)*this->width + r.x, source + row*stride, r.width);
+    AddDamage(r.x, r.y, r.width, r.height);
+}
+
+void Framebuffer::BlendBlit(int32_t x, int32_t y, const uint32_t* source, int32_t width, int32_t height, uint32_t stride)
+{
+    Rectangle r = { x, y, width, height };
+    if(!Clip(&r))
+        return;
+
+    source += (r.y - y)*stride + (r.x - x);
+    for(int32_t row = 0; row < r.height; row++)
+        blendPixels(backBuffer + (r.y + row)*this->width + r.x, source + row*stride, r.width);
+    AddDamage(r.x, r.y, r.width, r.height);
+}
+
+void Framebuffer::DrawCharacter(int32_t x, int32_t y, char c, uint32_t foreground, uint32_t background)
+{
+    if(x < 0 || y < 0 || x + FONT_WIDTH > width || y + 2*FONT_HEIGHT > height)
+        return;
+
+    const uint8_t* glyph = font8x8[(uint8_t)c & 0x7F];
+    uint32_t* target = backBuffer + y*width + x;
+    for(int32_t row = 0; row < 2*FONT_HEIGHT; row++, target += width)
+    {
+        uint8_t bits = glyph[row >> 1];
+        for(int32_t column = 0; column < FONT_WIDTH; column++)
+            target[column] = (bits & (0x80 >> column)) ? foreground : background;
+    }
+    AddDamage(x, y, FONT_WIDTH, 2*FONT_HEIGHT);
+}
+
+void Framebuffer::ShowCursor(bool visible)
+{
+    if(visible == cursorVisible)
+        return;
+    cursorVisible = visible;
+    AddDamage(cursor.x, cursor.y, cursor.width, cursor.height);
+}
+
+void Framebuffer::MoveCursor(int32_t x, int32_t y)
+{
+    if(x == cursor.x && y == cursor.y)
+        return;
+    if(cursorVisible)
+        AddDamage(cursor.x, cursor.y, cursor.width, cursor.height);
+    cursor.x = x;
+    cursor.y = y;
+    if(cursorVisible)
+        AddDamage(cursor.x, cursor.y, cursor.width, cursor.height);
+}
+
+void Framebuffer::FlushCursor()
+{
+    // Compose from the back buffer so video memory is never read
+    Rectangle r = cursor;
+    if(!Clip(&r))
+        return;
+
+    uint32_t line[CURSOR_WIDTH];
+    for(int32_t row = r.y; row < r.y + r.height; row++)
+    {
+        copyPixels(line, backBuffer + row*width + r.x, r.width);
+        blendPixels(line, cursorImage + (row - cursor.y)*CURSOR_WIDTH + (r.x - cursor.x), r.width);
+        copyPixels(frontBuffer + row*pitch + r.x, line, r.width);
+    }
+}
+
+void Framebuffer::Flush()
+{
+    if(frontBuffer == 0)
+    {
+        damageCount = 0;
+        return;
+    }
+
+    bool simd = FloatingPointUnit::Begin();
+    bool cursorDamaged = false;
+    for(uint32_t i = 0; i < damageCount; i++)
+    {
+        Rectangle& r = damage[i];
+        for(int32_t row = r.y; row < r.y + r.height; row++)
+        {
+            if(simd && r.width >= 16)
+                streamPixels(frontBuffer + row*pitch + r.x, backBuffer + row*width + r.x, r.width);
+            else
+                copyPixels(frontBuffer + row*pitch + r.x, backBuffer + row*width + r.x, r.width);
+        }
+        if(cursorVisible && touches(r, cursor))
+            cursorDamaged = true;
+    }
+    if(simd)
+        FloatingPointUnit::End();
+
+    if(cursorDamaged)
+        FlushCursor();
+    damageCount = 0;
+}
+
+
+static const uint32_t palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+GraphicsTextScreen::GraphicsTextScreen(Framebuffer* framebuffer, uint16_t* cells, uint16_t* drawn, uint16_t columns, uint16_t rows)
+{
+    this->framebuffer = framebuffer;
+    this->cells = cells;
+    this->drawn = drawn;
+    this->columns = columns;
+    this->rows = rows;
+
+    originX = (framebuffer->Width() - columns*FONT_WIDTH) / 2;
+    originY = (framebuffer->Height() - rows*2*FONT_HEIGHT) / 2;
+    if(originX < 0) originX = 0;
+    if(originY < 0) originY = 0;
+
+    framebuffer->FillRectangle(0, 0, framebuffer->Width(), framebuffer->Height(), palette[0]);
+    for(uint32_t i = 0; i < (uint32_t)columns*rows; i++)
+        drawn[i] = 0x0020; // black on black: differs from any visible cell
+}
+
+GraphicsTextScreen::~GraphicsTextScreen()
+{
+}
+
+void GraphicsTextScreen::Update()
+{
+    for(uint16_t row = 0; row < rows; row++)
+    {
+        for(uint16_t column = 0; column < columns; column++)
+        {
+            uint32_t i = row*columns + column;
+            uint16_t cell = cells[i];
+            if(cell == drawn[i])
+                continue;
+            drawn[i] = cell;
+            framebuffer->DrawCharacter(originX + column*FONT_WIDTH, originY + row*2*FONT_HEIGHT,
+                                       cell & 0xFF, palette[(cell >> 8) & 0xF], palette[(cell >> 12) & 0x7]);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef __GRAPHICS_H
+#define __GRAPHICS_H
+
+#include "types.h"
+
+#define GRAPHICS_MAX_WIDTH 1024
+#define GRAPHICS_MAX_HEIGHT 768
+#define GRAPHICS_MAX_DAMAGE 16
+
+#define CURSOR_WIDTH 12
+#define CURSOR_HEIGHT 19
+
+// Pixel kernels on 32-bit XRGB/ARGB spans
+void fillPixels(uint32_t* target, uint32_t color, uint32_t count);
+void copyPixels(uint32_t* target, const uint32_t* source, uint32_t count);
+// Copy with 16-byte non-temporal stores, for writing video memory. SSE2:
+// only call between FloatingPointUnit::Begin() and End().
+void streamPixels(uint32_t* target, const uint32_t* source, uint32_t count);
+// Source-over blend using the source's alpha byte
+void blendPixels(uint32_t* target, const uint32_t* source, uint32_t count);
+
+
+struct Rectangle {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+
+// Double-buffered linear framebuffer. All drawing goes to the back buffer
+// and records a damage rectangle; Flush() copies only the damaged areas to
+// video memory and composites the mouse cursor on the way out.
+class Framebuffer {
+    uint32_t* frontBuffer; // video memory, 0 when there is no framebuffer
+    uint32_t* backBuffer;
+    int32_t width;
+    int32_t height;
+    uint32_t pitch;        // front buffer pixels per scanline
+
+    Rectangle damage[GRAPHICS_MAX_DAMAGE];
+    uint32_t damageCount;
+
+    bool cursorVisible;
+    Rectangle cursor;
+
+    bool Clip(Rectangle* rectangle);
+    void FlushCursor();
+
+    public:
+        Framebuffer(uint32_t* frontBuffer, uint32_t width, uint32_t height, uint32_t pitchBytes, uint32_t* backBuffer);
+        ~Framebuffer();
+
+        bool Active();
+        int32_t Width();
+        int32_t Height();
+
+        void AddDamage(int32_t x, int32_t y, int32_t width, int32_t height);
+        uint32_t DamageCount();
+        Rectangle Damage(uint32_t n);
+
+        void FillRectangle(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color);
+        void Blit(int32_t x, int32_t y, const uint32_t* source, int32_t width, int32_t height, uint32_t stride);
+        void BlendBlit(int32_t x, int32_t y, const uint32_t* source, int32_t width, int32_t height, uint32_t stride);
+        // 8x16 cell: the 8x8 font with every row doubled
+        void DrawCharacter(int32_t x, int32_t y, char c, uint32_t foreground, uint32_t background);
+
+        void ShowCursor(bool visible);
+        void MoveCursor(int32_t x, int32_t y);
+
+        void Flush();
+};
+
+
+// Draws a VGA-style text cell buffer (the `video` a VirtualTerminal renders
+// into) onto a Framebuffer, touching only the cells that changed.
+class GraphicsTextScreen {
+    Framebuffer* framebuffer;
+    uint16_t* cells;
+    uint16_t* drawn; // what is currently on the framebuffer
+    uint16_t columns;
+    uint16_t rows;
+    int32_t originX;
+    int32_t originY;
+
+    public:
+        GraphicsTextScreen(Framebuffer* framebuffer, uint16_t* cells, uint16_t* drawn, uint16_t columns, uint16_t rows);
+        ~GraphicsTextScreen();
+
+        void Update();
+};
+
+#endif // !__GRAPHICS_H
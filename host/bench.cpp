@@ -0,0 +1,310 @@
+// Cycle-count microbenchmarks for hot paths, built and run on the
+// development machine with `make host-bench`. Each benchmark reports the
+// median cycles per operation over several batches and fails the run when
+// it exceeds its regression threshold.
+
+#include <stdio.h>
+
+#include "cpu.h"
+#include "gdt.h"
+#include "ringbuffer.h"
+#include "input.h"
+#include "keyboard.h"
+#include "terminal.h"
+#include "timer.h"
+#include "graphics.h"
+#include "fpu.h"
+#include "ipc.h"
+#include "paging.h"
+#include <string.h>
+
+#define BATCHES 15
+
+static volatile uint32_t sink;
+
+
+static void BenchSegmentDescriptor(uint32_t iterations)
+{
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        GlobalDescriptorTable::SegmentDescriptor descriptor(i << 12, i << 8, 0x92);
+        sink = descriptor.Base() + descriptor.Limit();
+    }
+}
+
+static void BenchScancodeDecoder(uint32_t iterations)
+{
+    static const uint8_t stream[8] = { 0x2A, 0x1E, 0x9E, 0xAA, 0xE0, 0x49, 0xE0, 0xC9 };
+    static ScancodeDecoder decoder;
+    InputEvent event;
+    for(uint32_t i = 0; i < iterations; i++)
+        if(decoder.Decode(stream[i & 7], &event))
+            sink = event.ascii;
+}
+
+static void BenchRingBuffer(uint32_t iterations)
+{
+    static RingBuffer<InputEvent, 256> ring;
+    InputEvent event = {};
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        event.code = i;
+        ring.Push(event);
+        ring.Pop(&event);
+    }
+    sink = event.code;
+}
+
+static void BenchInputQueue(uint32_t iterations)
+{
+    static InputEventQueue queue;
+    InputEvent events[64];
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        queue.PostMouseMove(1, -1);
+        if((i & 7) == 0)
+            queue.PostMouseButton(INPUT_MOUSE_DOWN, 1);
+        if((i & 63) == 63)
+            sink = queue.PollEvents(events, 64);
+    }
+}
+
+static char scrollback[1000][TERMINAL_COLUMNS];
+static uint16_t video[TERMINAL_COLUMNS*TERMINAL_ROWS];
+
+static void BenchTerminalDetached(uint32_t iterations)
+{
+    static VirtualTerminal terminal(scrollback[0], 1000);
+    for(uint32_t i = 0; i < iterations; i++)
+        terminal.PutChar((i % 81) == 80 ? '\n' : 'a' + (i & 15));
+}
+
+static void BenchTerminalAttached(uint32_t iterations)
+{
+    static VirtualTerminal terminal(scrollback[0], 1000);
+    terminal.Attach(video);
+    for(uint32_t i = 0; i < iterations; i++)
+        terminal.PutChar((i % 81) == 80 ? '\n' : 'a' + (i & 15));
+    terminal.Detach();
+}
+
+static void BenchTimerArmCancel(uint32_t iterations)
+{
+    static Timer timers[1024];
+    static TimerWheel wheel(0);
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        Timer* timer = &timers[i & 1023];
+        wheel.Add(timer, (i * 2654435761u) & 0xFFFFF);
+        if(i & 1)
+            wheel.Cancel(timer);
+    }
+    sink = wheel.Pending();
+}
+
+static void BenchTimerExpire(uint32_t iterations)
+{
+    static Timer timers[1024];
+    static TimerWheel wheel(0);
+    static uint64_t now = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        wheel.Add(&timers[i & 1023], now + 1 + ((i * 2654435761u) & 0xFFF));
+        wheel.Advance(now++);
+    }
+    sink = wheel.Pending();
+}
+
+static uint32_t frontPixels[1024*768];
+static uint32_t backPixels[1024*768];
+static uint32_t sprite[64*64];
+
+static void BenchFillRow(uint32_t iterations)
+{
+    for(uint32_t i = 0; i < iterations; i++)
+        fillPixels(backPixels + (i & 511)*1024, i, 1024);
+}
+
+static void BenchCopyRow(uint32_t iterations)
+{
+    for(uint32_t i = 0; i < iterations; i++)
+        copyPixels(frontPixels + (i & 511)*1024, backPixels + (i & 511)*1024, 1024);
+}
+
+static void BenchBlendSprite(uint32_t iterations)
+{
+    for(uint32_t i = 0; i < 64*64; i++)
+        sprite[i] = (i * 2654435761u) | 0x40000000;
+    for(uint32_t i = 0; i < iterations; i++)
+        blendPixels(backPixels + (i & 511)*1024, sprite + (i & 63)*64, 64);
+}
+
+static void BenchGlyphFlush(uint32_t iterations)
+{
+    static Framebuffer framebuffer(frontPixels, 1024, 768, 4096, backPixels);
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        framebuffer.DrawCharacter((i % 80) * 8, (i / 80 % 25) * 16, 'a' + (i & 15), 0xAAAAAA, 0);
+        framebuffer.Flush();
+    }
+}
+
+static void BenchFullFlush(uint32_t iterations)
+{
+    static Framebuffer framebuffer(frontPixels, 1024, 768, 4096, backPixels);
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        framebuffer.AddDamage(0, 0, 1024, 768);
+        framebuffer.Flush();
+    }
+}
+
+// Runs after the plain flush: once activated, Flush() takes the SSE path.
+// On cached host RAM the non-temporal stores lose to rep movs; the win is
+// on uncached video memory, which this cannot measure.
+static void BenchFullFlushStreamed(uint32_t iterations)
+{
+    static FpuContext context;
+    static FloatingPointUnit fpu(0);
+    if(FloatingPointUnit::ActiveFloatingPointUnit == 0)
+        fpu.Activate(&context);
+    BenchFullFlush(iterations);
+}
+
+class NullServer : public IpcServer {
+    public:
+        virtual void HandleCall(const IpcMessage& request, IpcMessage* reply)
+        {
+            reply->label = request.label;
+            reply->words[0] = request.words[0] + 1;
+        }
+};
+
+static void BenchIpcCall(uint32_t iterations)
+{
+    static IpcEndpoint endpoint(0);
+    static NullServer server;
+    endpoint.Bind(&server);
+    IpcMessage request, reply;
+    request.label = 1;
+    request.words[0] = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        endpoint.Call(request, &reply);
+        request.words[0] = reply.words[0];
+    }
+    sink = request.words[0];
+}
+
+static void BenchIpcSendReceive(uint32_t iterations)
+{
+    static IpcEndpoint endpoint(0);
+    IpcMessage message, received[16];
+    message.label = 1;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        message.words[0] = i;
+        endpoint.Send(message);
+        if((i & 15) == 15)
+            sink = endpoint.ReceiveBatch(received, 16);
+    }
+}
+
+// Ping-pongs one page between two mappings; compare with the 4 KiB copy
+static void BenchIpcPageTransfer(uint32_t iterations)
+{
+    static PagingManager paging(0x100000);
+    static IpcEndpoint endpoint(&paging);
+    uint32_t a = PAGING_SMALL_PAGES, b = PAGING_SMALL_PAGES + PAGE_SIZE;
+    paging.MapPage(a, 0x7000000, PAGE_WRITABLE);
+    IpcMessage message;
+    message.label = 1;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        endpoint.SendPage(&message, (i & 1) ? b : a);
+        endpoint.ReceiveBatch(&message, 1);
+        endpoint.AcceptPage(&message, (i & 1) ? a : b);
+    }
+    paging.UnmapPage((iterations & 1) ? b : a);
+}
+
+static void BenchPageCopy(uint32_t iterations)
+{
+    static uint8_t pages[2][4096];
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        memcpy(pages[~i & 1], pages[i & 1], 4096);
+        asm volatile("" : : : "memory");
+    }
+}
+
+
+typedef void (*BenchmarkFunction)(uint32_t iterations);
+
+struct Benchmark {
+    const char* name;
+    BenchmarkFunction run;
+    uint32_t iterations;      // operations per batch
+    uint32_t maxCyclesPerOp;  // regression threshold
+};
+
+static Benchmark benchmarks[] = {
+    { "gdt descriptor encode+decode", BenchSegmentDescriptor, 100000, 60 },
+    { "scancode decode", BenchScancodeDecoder, 100000, 60 },
+    { "ring buffer push+pop", BenchRingBuffer, 100000, 60 },
+    { "input queue post (coalesced)", BenchInputQueue, 100000, 200 },
+    { "terminal putchar, background", BenchTerminalDetached, 100000, 40 },
+    { "terminal putchar, on screen", BenchTerminalAttached, 100000, 200 },
+    { "timer arm/cancel", BenchTimerArmCancel, 100000, 100 },
+    { "timer arm + advance one tick", BenchTimerExpire, 100000, 300 },
+    { "fill 1024 pixel row", BenchFillRow, 10000, 1000 },
+    { "copy 1024 pixel row", BenchCopyRow, 10000, 1500 },
+    { "blend 64 pixel row", BenchBlendSprite, 10000, 1000 },
+    { "draw + flush one glyph", BenchGlyphFlush, 10000, 2000 },
+    { "flush full 1024x768 screen", BenchFullFlush, 20, 3000000 },
+    { "flush full 1024x768 screen, SSE", BenchFullFlushStreamed, 20, 3000000 },
+    { "ipc synchronous call", BenchIpcCall, 100000, 60 },
+    { "ipc send + batch receive", BenchIpcSendReceive, 100000, 100 },
+    { "ipc page transfer", BenchIpcPageTransfer, 100000, 300 },
+    { "4 KiB page copy, for comparison", BenchPageCopy, 100000, 2000 },
+};
+
+static uint64_t Median(uint64_t* values, uint32_t count)
+{
+    for(uint32_t i = 1; i < count; i++)
+        for(uint32_t j = i; j > 0 && values[j-1] > values[j]; j--)
+        {
+            uint64_t swap = values[j];
+            values[j] = values[j-1];
+            values[j-1] = swap;
+        }
+    return values[count / 2];
+}
+
+int main()
+{
+    int regressions = 0;
+    for(uint32_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++)
+    {
+        Benchmark& bench = benchmarks[b];
+        bench.run(bench.iterations); // warm up caches and branch predictors
+
+        uint64_t cycles[BATCHES];
+        for(uint32_t i = 0; i < BATCHES; i++)
+        {
+            uint64_t start = readTimestampCounter();
+            bench.run(bench.iterations);
+            cycles[i] = readTimestampCounter() - start;
+        }
+
+        double perOp = (double)Median(cycles, BATCHES) / bench.iterations;
+        bool regressed = perOp > bench.maxCyclesPerOp;
+        if(regressed)
+            regressions++;
+        printf("%-4s %-32s %10.1f cycles/op (limit %u)\n",
+               regressed ? "SLOW" : "ok", bench.name, perOp, bench.maxCyclesPerOp);
+    }
+
+    printf("%d regression(s)\n", regressions);
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Usage: boot-bench.sh mykernel.bin [boots]
+#
+# The kernel sees "bootbench" on its command line, writes its boot
+# timeline to the debugcon (port 0xE9) and powers QEMU off through
+# isa-debug-exit, which makes QEMU exit with status 1.
+
+kernel=$1
+boots=${2:-11}
+qemu=${QEMU:-qemu-system-i386}
+log=$(mktemp)
+kernel_times=$(mktemp)
+wall_times=$(mktemp)
+trap 'rm -f "$log" "$kernel_times" "$wall_times"' EXIT
+
+if ! command -v "$qemu" >/dev/null 2>&1; then
+    echo "boot-bench: $qemu not found" >&2
+    exit 1
+fi
+
+median() {
+    sort -n "$1" | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+for i in $(seq "$boots"); do
+    start=$(date +%s%N)
+    timeout 30 "$qemu" -kernel "$kernel" -append bootbench -m 64M \
+        -display none -serial none -monitor none \
+        -debugcon "file:$log" \
+        -device isa-debug-exit,iobase=0xf4,iosize=0x04
+    status=$?
+    end=$(date +%s%N)
+
+    if [ $status -ne 1 ]; then
+        echo "boot-bench: boot $i did not finish (qemu status $status)" >&2
+        exit 1
+    fi
+    awk '$1 == "boot-total" { print $2 }' "$log" >> "$kernel_times"
+    echo $(( (end - start) / 1000 )) >> "$wall_times"
+done
+
+echo "last boot timeline (checkpoint, stage us, total us):"
+grep '^boot ' "$log"
+echo "median over $boots boots: kernel $(median "$kernel_times") us, wall $(median "$wall_times") us"
@@ -0,0 +1,155 @@
+// Host replacements for port.cpp and the bits of interrupts.cpp the drivers
+// link against, so drivers can be driven from tests without hardware.
+
+#include "port.h"
+#include "interrupts.h"
+#include "hostport.h"
+
+#define HOST_PORT_SCRIPT 1024
+#define HOST_PORT_LOG 4096
+
+static uint32_t defaults[65536];
+
+static uint16_t scriptPort[HOST_PORT_SCRIPT];
+static uint32_t scriptValue[HOST_PORT_SCRIPT];
+static bool scriptUsed[HOST_PORT_SCRIPT];
+static uint32_t scriptLength = 0;
+
+static uint16_t logPort[HOST_PORT_LOG];
+static uint32_t logValue[HOST_PORT_LOG];
+static uint32_t logLength = 0;
+
+void hostPortReset() {
+    for(uint32_t i = 0; i < 65536; i++)
+        defaults[i] = 0xFFFFFFFF; // floating bus
+    scriptLength = 0;
+    logLength = 0;
+}
+
+void hostPortSetDefault(uint16_t port, uint32_t value) {
+    defaults[port] = value;
+}
+
+void hostPortQueueRead(uint16_t port, uint32_t value) {
+    if(scriptLength == HOST_PORT_SCRIPT)
+        return;
+    scriptPort[scriptLength] = port;
+    scriptValue[scriptLength] = value;
+    scriptUsed[scriptLength] = false;
+    scriptLength++;
+}
+
+uint32_t hostPortPendingReads() {
+    uint32_t pending = 0;
+    for(uint32_t i = 0; i < scriptLength; i++)
+        if(!scriptUsed[i])
+            pending++;
+    return pending;
+}
+
+uint32_t hostPortWriteCount() {
+    return logLength;
+}
+
+uint16_t hostPortWritePort(uint32_t n) {
+    return n < logLength ? logPort[n] : 0;
+}
+
+uint32_t hostPortWriteValue(uint32_t n) {
+    return n < logLength ? logValue[n] : 0;
+}
+
+static uint32_t hostRead(uint16_t port) {
+    for(uint32_t i = 0; i < scriptLength; i++)
+    {
+        if(!scriptUsed[i] && scriptPort[i] == port)
+        {
+            scriptUsed[i] = true;
+            return scriptValue[i];
+        }
+    }
+    return defaults[port];
+}
+
+static void hostWrite(uint16_t port, uint32_t value) {
+    if(logLength == HOST_PORT_LOG)
+        return;
+    logPort[logLength] = port;
+    logValue[logLength] = value;
+    logLength++;
+}
+
+
+Port::Port(uint16_t portnumber) {
+    this->portnumber = portnumber;
+}
+
+Port::~Port(){
+}
+
+Port8Bit::Port8Bit(uint16_t portnumber) : Port(portnumber) {
+}
+
+Port8Bit::~Port8Bit() {
+}
+
+void Port8Bit::Write(uint8_t data) {
+    hostWrite(portnumber, data);
+}
+
+uint8_t Port8Bit::Read(){
+    return hostRead(portnumber);
+}
+
+Port8BitSlow::Port8BitSlow(uint16_t portnumber) : Port8Bit(portnumber){
+}
+
+Port8BitSlow::~Port8BitSlow(){
+}
+
+void Port8BitSlow::Write(uint8_t data){
+    hostWrite(portnumber, data);
+}
+
+Port16Bit::Port16Bit(uint16_t portnumber) : Port(portnumber){
+}
+
+Port16Bit::~Port16Bit(){
+}
+
+void Port16Bit::Write(uint16_t data){
+    hostWrite(portnumber, data);
+}
+
+uint16_t Port16Bit::Read(){
+    return hostRead(portnumber);
+}
+
+Port32Bit::Port32Bit(uint16_t portnumber) : Port(portnumber){
+}
+
+Port32Bit::~Port32Bit(){
+}
+
+void Port32Bit::Write(uint32_t data){
+    hostWrite(portnumber, data);
+}
+
+uint32_t Port32Bit::Read(){
+    return hostRead(portnumber);
+}
+
+
+// Drivers are constructed with a null InterruptManager in tests and have
+// HandleInterrupt() called directly.
+InterruptHandler::InterruptHandler(uint8_t interruptNumber, InterruptManager* interruptManager){
+    this->interruptNumber = interruptNumber;
+    this->interruptManager = interruptManager;
+}
+
+InterruptHandler::~InterruptHandler(){
+}
+
+uint32_t InterruptHandler::HandleInterrupt(uint32_t esp){
+    return esp;
+}
@@ -0,0 +1,19 @@
+#ifndef __HOSTPORT_H
+#define __HOSTPORT_H
+
+#include "types.h"
+
+// Fake I/O space backing port.h in host builds. Reads are served from a
+// per-test script (first queued value for that port wins), falling back to
+// a per-port default; every write is logged.
+
+void hostPortReset();
+void hostPortSetDefault(uint16_t port, uint32_t value);
+void hostPortQueueRead(uint16_t port, uint32_t value);
+uint32_t hostPortPendingReads();
+
+uint32_t hostPortWriteCount();
+uint16_t hostPortWritePort(uint32_t n);
+uint32_t hostPortWriteValue(uint32_t n);
+
+#endif // __HOSTPORT_H
@@ -0,0 +1,1222 @@
+// Unit tests for the hardware-independent parts of the kernel, built and
+// run on the development machine with `make host-test`.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gdt.h"
+#include "ringbuffer.h"
+#include "input.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "terminal.h"
+#include "timer.h"
+#include "memory.h"
+#include "graphics.h"
+#include "font.h"
+#include "fpu.h"
+#include "ipc.h"
+#include "paging.h"
+#include "boot.h"
+#include "ata.h"
+#include "fat32.h"
+#include "hostport.h"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        checks++; \
+        if(!(condition)) { \
+            failures++; \
+            printf("    %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while(0)
+
+
+static void TestSegmentDescriptor()
+{
+    GlobalDescriptorTable::SegmentDescriptor code(0, 64*1024*1024, 0x9A);
+    CHECK(code.Base() == 0);
+    CHECK(code.Limit() == 64*1024*1024 - 1);
+
+    uint8_t raw[8];
+    memcpy(raw, &code, 8);
+    CHECK(raw[5] == 0x9A);
+    CHECK((raw[6] & 0xC0) == 0xC0); // 32-bit, 4 KiB granularity
+
+    GlobalDescriptorTable::SegmentDescriptor small(0x12345678, 0xFFFF, 0x92);
+    CHECK(small.Base() == 0x12345678);
+    CHECK(small.Limit() == 0xFFFF);
+    memcpy(raw, &small, 8);
+    CHECK(raw[2] == 0x78 && raw[3] == 0x56 && raw[4] == 0x34 && raw[7] == 0x12);
+    CHECK((raw[6] & 0x80) == 0); // byte granularity
+
+    // Flat 4 GiB segment as used by the kernel's code and data selectors
+    GlobalDescriptorTable::SegmentDescriptor flat(0, 0xFFFFFFFF, 0x92);
+    CHECK(flat.Base() == 0);
+    CHECK(flat.Limit() == 0xFFFFFFFF);
+    memcpy(raw, &flat, 8);
+    CHECK(raw[0] == 0xFF && raw[1] == 0xFF && raw[6] == 0xCF);
+
+    GlobalDescriptorTable::SegmentDescriptor null(0, 0, 0);
+    CHECK(null.Base() == 0);
+    CHECK(null.Limit() == 0);
+    CHECK(sizeof(GlobalDescriptorTable::SegmentDescriptor) == 8);
+}
+
+static void TestRingBuffer()
+{
+    RingBuffer<int, 4> ring;
+    int value;
+    CHECK(ring.Empty());
+    CHECK(ring.Newest() == 0);
+    CHECK(!ring.Pop(&value));
+
+    for(int i = 0; i < 4; i++)
+        CHECK(ring.Push(i));
+    CHECK(ring.Full());
+    CHECK(!ring.Push(99));
+    CHECK(*ring.Newest() == 3);
+
+    // Wrap around the end of the storage a few times
+    for(int i = 4; i < 20; i++)
+    {
+        CHECK(ring.Pop(&value) && value == i - 4);
+        CHECK(ring.Push(i));
+    }
+    CHECK(ring.Count() == 4);
+    ring.Clear();
+    CHECK(ring.Empty());
+
+    // In-place push is invisible until committed
+    int* slot = ring.Reserve();
+    CHECK(slot != 0);
+    *slot = 42;
+    CHECK(ring.Empty());
+    ring.Commit();
+    CHECK(ring.Pop(&value) && value == 42);
+}
+
+static void TestScancodeDecoder()
+{
+    ScancodeDecoder decoder;
+    InputEvent event;
+
+    CHECK(decoder.Decode(0x1E, &event));
+    CHECK(event.type == INPUT_KEY_DOWN && event.ascii == 'a' && event.code == 0x1E);
+    CHECK(decoder.Decode(0x9E, &event));
+    CHECK(event.type == INPUT_KEY_UP && event.code == 0x1E);
+
+    // Shift held, then caps lock on top of it
+    CHECK(decoder.Decode(KEY_LEFT_SHIFT, &event));
+    CHECK(decoder.Decode(0x1E, &event));
+    CHECK(event.ascii == 'A' && (event.modifiers & INPUT_MOD_SHIFT));
+    CHECK(decoder.Decode(0x02, &event));
+    CHECK(event.ascii == '!');
+    CHECK(decoder.Decode(KEY_LEFT_SHIFT | 0x80, &event));
+    CHECK(decoder.Modifiers() == 0);
+
+    CHECK(decoder.Decode(KEY_CAPSLOCK, &event));
+    CHECK(decoder.Decode(KEY_CAPSLOCK | 0x80, &event));
+    CHECK(decoder.Decode(0x1E, &event));
+    CHECK(event.ascii == 'A');
+    CHECK(decoder.Decode(0x02, &event));
+    CHECK(event.ascii == '1');
+    CHECK(decoder.Decode(KEY_CAPSLOCK, &event));
+
+    // Extended keys, including the fake shift some keyboards send
+    CHECK(!decoder.Decode(0xE0, &event));
+    CHECK(decoder.Decode(0x49, &event));
+    CHECK(event.code == KEY_PAGE_UP && event.ascii == 0);
+    CHECK(!decoder.Decode(0xE0, &event));
+    CHECK(!decoder.Decode(0x2A, &event));
+
+    CHECK(!decoder.Decode(0xE0, &event));
+    CHECK(decoder.Decode(0x38, &event));
+    CHECK(event.code == KEY_RIGHT_ALT && (event.modifiers & INPUT_MOD_ALT));
+    CHECK(decoder.Decode(KEY_F2, &event));
+    CHECK(event.code == KEY_F2 && (event.modifiers & INPUT_MOD_ALT));
+
+    // Controller ACKs are not keys
+    CHECK(!decoder.Decode(0xFA, &event));
+}
+
+static void TestInputQueueCoalescing()
+{
+    InputEventQueue queue;
+    InputEvent events[8];
+
+    queue.PostMouseMove(1, 2);
+    queue.PostMouseMove(3, -4);
+    queue.PostMouseButton(INPUT_MOUSE_DOWN, 1);
+    queue.PostMouseMove(5, 5);
+    queue.PostMouseWheel(1);
+    queue.PostMouseWheel(2);
+
+    uint32_t count = queue.PollEvents(events, 8);
+    CHECK(count == 4);
+    CHECK(events[0].type == INPUT_MOUSE_MOVE && events[0].dx == 4 && events[0].dy == -2);
+    CHECK(events[1].type == INPUT_MOUSE_DOWN && events[1].code == 1);
+    CHECK(events[2].type == INPUT_MOUSE_MOVE && events[2].dx == 5);
+    CHECK(events[3].type == INPUT_MOUSE_WHEEL && events[3].dy == 3);
+    CHECK(events[0].timestamp <= events[1].timestamp);
+
+    // A move the consumer already took is never modified
+    queue.PostMouseMove(1, 1);
+    CHECK(queue.PollEvents(events, 1) == 1);
+    queue.PostMouseMove(1, 1);
+    CHECK(queue.PollEvents(events, 8) == 1 && events[0].dx == 1);
+
+    queue.PostKey(INPUT_KEY_DOWN, 0x1E, 'a', 0);
+    queue.WaitEvent(&events[0]);
+    CHECK(events[0].type == INPUT_KEY_DOWN && events[0].ascii == 'a');
+}
+
+static void TestKeyboardDriver()
+{
+    hostPortReset();
+    InputEventQueue queue;
+    KeyboardDriver keyboard(0, &queue);
+    InputEvent events[4];
+
+    hostPortQueueRead(0x60, 0x23);
+    keyboard.HandleInterrupt(0);
+    hostPortQueueRead(0x60, 0xA3);
+    keyboard.HandleInterrupt(0);
+
+    CHECK(queue.PollEvents(events, 4) == 2);
+    CHECK(events[0].type == INPUT_KEY_DOWN && events[0].ascii == 'h');
+    CHECK(events[1].type == INPUT_KEY_UP && events[1].code == 0x23);
+
+    // A status port stuck at "output full" must not hang Activate()
+    hostPortReset();
+    hostPortSetDefault(0x64, 0x01);
+    for(int i = 0; i < 16; i++)
+        hostPortQueueRead(0x60, 0xAA);
+    hostPortQueueRead(0x60, 0x57); // controller command byte
+    keyboard.Activate();
+    CHECK(hostPortPendingReads() == 0);
+    uint32_t writes = hostPortWriteCount();
+    CHECK(writes == 5);
+    CHECK(hostPortWritePort(2) == 0x64 && hostPortWriteValue(2) == 0x60);
+    CHECK(hostPortWritePort(3) == 0x60 && hostPortWriteValue(3) == 0x47);
+    CHECK(hostPortWritePort(4) == 0x60 && hostPortWriteValue(4) == 0xF4);
+}
+
+static void FeedMouse(MouseDriver* mouse, const uint8_t* bytes, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        hostPortQueueRead(0x60, bytes[i]);
+        mouse->HandleInterrupt(0);
+    }
+}
+
+static void TestMouseDriver()
+{
+    hostPortReset();
+    hostPortSetDefault(0x64, 0x21); // output buffer full, from the aux port
+    InputEventQueue queue;
+    MouseDriver mouse(0, &queue);
+    InputEvent events[8];
+
+    // Controller config byte, then ACKs for the knock, ID 3, then settings
+    hostPortQueueRead(0x60, 0x47);
+    for(int i = 0; i < 7; i++)
+        hostPortQueueRead(0x60, 0xFA);
+    hostPortQueueRead(0x60, 0x03);
+    for(int i = 0; i < 5; i++)
+        hostPortQueueRead(0x60, 0xFA);
+    mouse.Activate();
+    CHECK(mouse.HasWheel());
+    CHECK(hostPortPendingReads() == 0);
+
+    // A stray byte without bit 3 is dropped, then a normal packet follows
+    const uint8_t packets[] = {
+        0x00,
+        0x08, 0x05, 0x03, 0x00,    // dx=5 dy=3
+        0x18, 0xFE, 0x00, 0x0F,    // dx=-2, wheel -1
+        0x09, 0x00, 0x00, 0x00,    // left button down
+        0x49, 0x10, 0x10, 0x00,    // x overflow: motion dropped
+        0x08, 0x00, 0x00, 0x00     // left button up
+    };
+    FeedMouse(&mouse, packets, sizeof(packets));
+
+    uint32_t count = queue.PollEvents(events, 8);
+    CHECK(count == 4);
+    CHECK(events[0].type == INPUT_MOUSE_MOVE && events[0].dx == 3 && events[0].dy == -3);
+    CHECK(events[1].type == INPUT_MOUSE_WHEEL && events[1].dy == -1);
+    CHECK(events[2].type == INPUT_MOUSE_DOWN && events[2].code == 1);
+    CHECK(events[3].type == INPUT_MOUSE_UP && events[3].code == 1);
+}
+
+// Both drivers against one controller, in kernelMain's order
+static void TestPs2Activation()
+{
+    hostPortReset();
+    hostPortSetDefault(0x64, 0x21);
+    hostPortQueueRead(0x64, 0x00); // nothing left over from the BIOS
+    InputEventQueue queue;
+    KeyboardDriver keyboard(0, &queue);
+    MouseDriver mouse(0, &queue);
+
+    hostPortQueueRead(0x60, 0x45); // controller command byte
+    hostPortQueueRead(0x60, 0xFA); // keyboard ACK for 0xF4
+    hostPortQueueRead(0x60, 0x45); // command byte again, for the mouse
+    for(int i = 0; i < 7; i++)
+        hostPortQueueRead(0x60, 0xFA);
+    hostPortQueueRead(0x60, 0x03);
+    for(int i = 0; i < 5; i++)
+        hostPortQueueRead(0x60, 0xFA);
+    keyboard.Activate();
+    mouse.Activate();
+    CHECK(hostPortPendingReads() == 0);
+    CHECK(mouse.HasWheel());
+
+    // Each 0x60 "set command byte" must write back what 0x20 returned
+    uint32_t written = 0;
+    uint8_t commandBytes[2] = { 0, 0 };
+    for(uint32_t i = 0; i + 1 < hostPortWriteCount(); i++)
+        if(hostPortWritePort(i) == 0x64 && hostPortWriteValue(i) == 0x60 && written < 2)
+            commandBytes[written++] = hostPortWriteValue(i + 1);
+    CHECK(written == 2);
+    CHECK(commandBytes[0] == 0x45 && commandBytes[1] == 0x47);
+}
+
+static void TestTerminalScrollback()
+{
+    static char storage[30][TERMINAL_COLUMNS];
+    static uint16_t video[TERMINAL_COLUMNS*TERMINAL_ROWS];
+    char line[16];
+
+    VirtualTerminal terminal(storage[0], 30);
+
+    // Output while detached must not reach video memory
+    for(uint32_t i = 0; i < TERMINAL_COLUMNS*TERMINAL_ROWS; i++)
+        video[i] = 0xBEEF;
+    terminal.Write("hello\nworld");
+    CHECK(video[0] == 0xBEEF);
+    CHECK(terminal.CharAt(0, 0) == 'h' && terminal.CharAt(1, 4) == 'd');
+
+    terminal.Attach(video);
+    CHECK(video[0] == 0x0768 && video[TERMINAL_COLUMNS + 4] == 0x0764);
+    CHECK(video[TERMINAL_COLUMNS*24] == 0x0720);
+
+    // Long lines wrap
+    terminal.Clear();
+    for(int i = 0; i < TERMINAL_COLUMNS + 1; i++)
+        terminal.PutChar('x');
+    CHECK(terminal.LineCount() == 2 && terminal.CharAt(1, 0) == 'x');
+
+    // 40 numbered lines through a 30 line ring: the first 11 are gone
+    terminal.Clear();
+    for(int i = 0; i < 40; i++)
+    {
+        sprintf(line, "%02d\n", i);
+        terminal.Write(line);
+    }
+    CHECK(terminal.LineCount() == 30);
+    CHECK(terminal.CharAt(23, 0) == '3' && terminal.CharAt(23, 1) == '9');
+    CHECK(video[TERMINAL_COLUMNS*23 + 1] == 0x0739);
+
+    terminal.ScrollBack(100);
+    CHECK(terminal.ScrollOffset() == 5);
+    CHECK(terminal.CharAt(0, 0) == '1' && terminal.CharAt(0, 1) == '1');
+    CHECK(video[0] == 0x0731 && video[1] == 0x0731);
+
+    // New output keeps a scrolled view in place while history remains
+    terminal.ScrollForward(2);
+    CHECK(terminal.CharAt(0, 0) == '1' && terminal.CharAt(0, 1) == '3');
+    terminal.Write("40\n");
+    CHECK(terminal.ScrollOffset() == 4);
+    CHECK(terminal.CharAt(0, 0) == '1' && terminal.CharAt(0, 1) == '3');
+
+    terminal.ScrollForward(100);
+    CHECK(terminal.ScrollOffset() == 0);
+    CHECK(terminal.CharAt(23, 0) == '4' && terminal.CharAt(23, 1) == '0');
+
+    // Scrolled to the oldest line of a full ring, new output drops that
+    // line: the view moves up and the screen has to follow
+    terminal.ScrollBack(100);
+    terminal.Write("41\n");
+    CHECK(terminal.ScrollOffset() == 5);
+    CHECK(terminal.CharAt(0, 0) == '1' && terminal.CharAt(0, 1) == '3');
+    bool matches = true;
+    for(int row = 0; row < TERMINAL_ROWS; row++)
+        for(int column = 0; column < 2; column++)
+            matches = matches && video[TERMINAL_COLUMNS*row + column] == (0x0700 | (uint8_t)terminal.CharAt(row, column));
+    CHECK(matches);
+}
+
+static void TestTerminalManager()
+{
+    static char storage[2][TERMINAL_ROWS*2][TERMINAL_COLUMNS];
+    static uint16_t video[TERMINAL_COLUMNS*TERMINAL_ROWS];
+    VirtualTerminal terminals[2] = {
+        VirtualTerminal(storage[0][0], TERMINAL_ROWS*2),
+        VirtualTerminal(storage[1][0], TERMINAL_ROWS*2)
+    };
+    TerminalManager screen(terminals, 2, video);
+
+    terminals[0].Write("a");
+    terminals[1].Write("b");
+    CHECK(video[0] == 0x0761);
+
+    InputEvent event;
+    event.type = INPUT_KEY_DOWN;
+    event.modifiers = INPUT_MOD_ALT;
+    event.code = KEY_F2;
+    event.ascii = 0;
+    CHECK(screen.HandleKey(event));
+    CHECK(screen.ActiveIndex() == 1 && video[0] == 0x0762);
+
+    terminals[0].Write("c");
+    CHECK(video[1] == 0x0720);
+
+    event.code = KEY_F4; // only two terminals
+    CHECK(screen.HandleKey(event));
+    CHECK(screen.ActiveIndex() == 1);
+
+    for(int i = 0; i < 60; i++)
+        terminals[1].Write("line\n");
+    event.modifiers = INPUT_MOD_SHIFT;
+    event.code = KEY_PAGE_UP;
+    CHECK(screen.HandleKey(event));
+    CHECK(terminals[1].ScrollOffset() == TERMINAL_ROWS - 1);
+
+    event.modifiers = 0;
+    event.code = 0x1E;
+    event.ascii = 'a';
+    CHECK(!screen.HandleKey(event));
+}
+
+static uint64_t wheelNow;
+
+class RecordingTimer : public Timer {
+    public:
+        uint64_t fired;
+        int count;
+        RecordingTimer() : fired(0), count(0) {}
+        void OnExpire() { fired = wheelNow; count++; }
+};
+
+class RearmingTimer : public Timer {
+    public:
+        TimerWheel* wheel;
+        Timer* victim;
+        int count;
+        void OnExpire()
+        {
+            count++;
+            if(victim != 0)
+                wheel->Cancel(victim);
+            if(count < 3)
+                wheel->Add(this, wheelNow + 100);
+        }
+};
+
+static void TestTimerWheel()
+{
+    static RecordingTimer timers[2000];
+    TimerWheel wheel(5);
+
+    // Spread expiries over every level, including past the top one
+    uint32_t seed = 12345;
+    for(int i = 0; i < 2000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint64_t expires = 5 + (seed >> 8) % (i < 1900 ? 300000 : 30000000);
+        wheel.Add(&timers[i], expires);
+    }
+    CHECK(wheel.Pending() == 2000);
+
+    wheel.Cancel(&timers[7]);
+    wheel.Cancel(&timers[7]);
+    CHECK(wheel.Pending() == 1999);
+
+    // Tick by tick for a while, then in big tickless-style jumps
+    for(wheelNow = 5; wheelNow < 300000; wheelNow++)
+        wheel.Advance(wheelNow);
+    bool monotonic = true;
+    while(wheel.Pending() != 0)
+    {
+        uint64_t next;
+        wheel.NextExpiry(&next);
+        if(next < wheelNow)
+            monotonic = false;
+        wheelNow = next;
+        wheel.Advance(wheelNow);
+    }
+    CHECK(monotonic);
+
+    bool exact = true;
+    for(int i = 0; i < 2000; i++)
+    {
+        if(i == 7)
+            continue;
+        if(timers[i].count != 1 || timers[i].fired != timers[i].Expires())
+            exact = false;
+    }
+    CHECK(exact);
+    CHECK(timers[7].count == 0);
+    CHECK(!wheel.NextExpiry(&wheelNow));
+
+    // Callbacks may re-arm themselves and cancel timers due in the same tick
+    TimerWheel wheel2(0);
+    RecordingTimer victim;
+    RearmingTimer rearming;
+    rearming.wheel = &wheel2;
+    rearming.victim = &victim;
+    rearming.count = 0;
+    wheel2.Add(&victim, 10);
+    wheel2.Add(&rearming, 10); // slots run newest first
+    for(wheelNow = 0; wheelNow < 1000; wheelNow++)
+        wheel2.Advance(wheelNow);
+    CHECK(rearming.count == 3);
+    CHECK(victim.count == 0 && !victim.Pending());
+    CHECK(wheel2.Pending() == 0);
+}
+
+static void TestPhysicalMemory()
+{
+    static PhysicalMemoryManager memory;
+
+    // A typical 8 GiB PC: low RAM up to 3 GiB, the rest above 4 GiB
+    memory.AddRegion(0, 0x9FC00);
+    memory.AddRegion(0x100000, 0xC0000000 - 0x100000);
+    memory.AddRegion(0x100000000ULL, 0x140000000ULL);
+    memory.Reserve(0, 0x36B250); // kernel image
+
+    CHECK(memory.HighestAddress() == 0x240000000ULL);
+    // 0..1 MiB holes and the kernel cost the first two frames
+    CHECK(memory.TotalFrames() == 1536 - 2 + 2560);
+    CHECK(memory.AvailableFrames() == memory.TotalFrames());
+
+    uint64_t high = memory.AllocateFrame();
+    CHECK(high == 0x240000000ULL - FRAME_SIZE);
+    uint64_t low = memory.AllocateLowFrame();
+    CHECK(low == 0x400000);
+    CHECK(memory.AvailableFrames() == memory.TotalFrames() - 2);
+
+    memory.FreeFrame(high);
+    memory.FreeFrame(high);
+    CHECK(memory.AllocateFrame() == high);
+
+    // Running out of low memory must not hand out high frames
+    uint32_t lowFrames = 0;
+    while(memory.AllocateLowFrame() != MEMORY_NO_FRAME)
+        lowFrames++;
+    CHECK(lowFrames == (MEMORY_LOWMEM_LIMIT >> FRAME_SHIFT) - 3);
+
+    uint32_t rest = 0;
+    uint64_t frame;
+    bool aligned = true;
+    while((frame = memory.AllocateFrame()) != MEMORY_NO_FRAME)
+    {
+        if(frame & (FRAME_SIZE - 1))
+            aligned = false;
+        rest++;
+    }
+    CHECK(aligned);
+    CHECK(memory.AvailableFrames() == 0);
+    CHECK(rest + lowFrames + 2 == memory.TotalFrames());
+}
+
+static FpuContext kernelContext, contextA, contextB;
+
+static void TestFloatingPointUnit()
+{
+    static FloatingPointUnit fpu(0);
+    fpu.Activate(&kernelContext);
+    CHECK(fpu.SimdSupported());
+    CHECK(fpu.Current() == &kernelContext && fpu.Owner() == 0);
+
+    // First use of a context loads the clean initial state
+    fpu.SwitchTo(&contextA);
+    fpu.HandleInterrupt(0);
+    CHECK(fpu.Owner() == &contextA && contextA.initialized);
+    CHECK(fpu.Saves() == 0 && fpu.Restores() == 0);
+    uint32_t mxcsr;
+    asm volatile("stmxcsr %0" : "=m" (mxcsr));
+    CHECK(mxcsr == 0x1F80);
+
+    // Switching away saves the registers on the next trap
+    uint32_t marker[4] = { 0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210 };
+    asm volatile("movdqu %0, %%xmm7" : : "m" (marker) : "xmm7");
+    fpu.SwitchTo(&contextB);
+    fpu.HandleInterrupt(0);
+    CHECK(fpu.Owner() == &contextB && fpu.Saves() == 1);
+    CHECK(memcmp(contextA.state + 160 + 7*16, marker, 16) == 0);
+
+    // Switching without touching the FPU costs nothing
+    fpu.SwitchTo(&contextA);
+    CHECK(fpu.Saves() == 1 && fpu.Restores() == 0);
+    fpu.HandleInterrupt(0);
+    uint32_t readBack[4];
+    asm volatile("movdqu %%xmm7, %0" : "=m" (readBack));
+    CHECK(memcmp(readBack, marker, 16) == 0);
+    CHECK(fpu.Saves() == 2 && fpu.Restores() == 1);
+
+    fpu.HandleInterrupt(0); // already the owner
+    CHECK(fpu.Saves() == 2 && fpu.Restores() == 1);
+
+    // Kernel SIMD sections save the owner and leave the registers unowned
+    CHECK(FloatingPointUnit::Begin());
+    CHECK(fpu.Owner() == 0 && fpu.Saves() == 3);
+    CHECK(!FloatingPointUnit::Begin()); // nested, e.g. from an IRQ handler
+
+    // A trap inside the section (TS set by a switch from an interrupt
+    // handler) leaves the kernel's scratch registers alone
+    fpu.SwitchTo(&contextB);
+    fpu.HandleInterrupt(0);
+    CHECK(fpu.Owner() == 0 && fpu.Saves() == 3 && fpu.Restores() == 1);
+    fpu.SwitchTo(&contextA);
+    uint32_t source[70], target[72];
+    for(int i = 0; i < 70; i++)
+        source[i] = i * 7;
+    target[0] = target[71] = 0xAAAAAAAA;
+    streamPixels(target + 1, source, 70);
+    FloatingPointUnit::End();
+    CHECK(memcmp(target + 1, source, sizeof(source)) == 0);
+    CHECK(target[0] == 0xAAAAAAAA && target[71] == 0xAAAAAAAA);
+
+    fpu.HandleInterrupt(0);
+    CHECK(fpu.Owner() == &contextA && fpu.Restores() == 2);
+}
+
+static void TestPixelKernels()
+{
+    uint32_t a[37], b[37];
+    fillPixels(a, 0x11223344, 37);
+    bool filled = true;
+    for(int i = 0; i < 37; i++)
+        filled = filled && a[i] == 0x11223344;
+    CHECK(filled);
+
+    for(int i = 0; i < 37; i++)
+        b[i] = i;
+    copyPixels(a + 1, b, 35);
+    CHECK(a[0] == 0x11223344 && a[1] == 0 && a[35] == 34 && a[36] == 0x11223344);
+
+    uint32_t target[4] = { 0x00FF0000, 0x00FF0000, 0x00FF0000, 0x00204060 };
+    uint32_t source[4] = { 0x000000FF, 0xFF0000FF, 0x800000FF, 0x80A0C0E0 };
+    blendPixels(target, source, 4);
+    CHECK(target[0] == 0x00FF0000); // fully transparent
+    CHECK(target[1] == 0xFF0000FF); // fully opaque
+    CHECK(target[2] == 0xFF7E007F); // roughly half and half
+    CHECK(target[3] == 0xFF5F7F9F);
+}
+
+static uint32_t front[66*48]; // pitch of 66 pixels
+static uint32_t back[64*48];
+
+static void TestFramebufferDamage()
+{
+    static Framebuffer framebuffer(front, 64, 48, 66*4, back);
+
+    framebuffer.AddDamage(-5, -5, 10, 10);
+    CHECK(framebuffer.DamageCount() == 1);
+    Rectangle r = framebuffer.Damage(0);
+    CHECK(r.x == 0 && r.y == 0 && r.width == 5 && r.height == 5);
+
+    // Adjacent cells merge, distant ones don't, off screen is dropped
+    framebuffer.AddDamage(5, 0, 8, 5);
+    framebuffer.AddDamage(40, 40, 100, 100);
+    framebuffer.AddDamage(64, 0, 8, 8);
+    CHECK(framebuffer.DamageCount() == 2);
+    r = framebuffer.Damage(0);
+    CHECK(r.x == 0 && r.width == 13 && r.height == 5);
+    r = framebuffer.Damage(1);
+    CHECK(r.x == 40 && r.y == 40 && r.width == 24 && r.height == 8);
+
+    // A full list collapses into its bounding box
+    framebuffer.Flush();
+    for(int i = 0; i < GRAPHICS_MAX_DAMAGE + 1; i++)
+        framebuffer.AddDamage(i * 3, i * 2, 1, 1);
+    CHECK(framebuffer.DamageCount() == 1);
+    r = framebuffer.Damage(0);
+    CHECK(r.x == 0 && r.y == 0 && r.width == 3*GRAPHICS_MAX_DAMAGE + 1 && r.height == 2*GRAPHICS_MAX_DAMAGE + 1);
+    framebuffer.Flush();
+    CHECK(framebuffer.DamageCount() == 0);
+}
+
+static void TestFramebufferFlush()
+{
+    static Framebuffer framebuffer(front, 64, 48, 66*4, back);
+    framebuffer.FillRectangle(0, 0, 64, 48, 0x000000);
+    framebuffer.Flush();
+
+    // Only the damaged rectangle reaches the front buffer
+    fillPixels(front, 0xDEADBEEF, 66*48);
+    framebuffer.FillRectangle(10, 20, 4, 3, 0x123456);
+    framebuffer.Flush();
+    CHECK(front[20*66 + 10] == 0x123456 && front[22*66 + 13] == 0x123456);
+    CHECK(front[20*66 + 9] == 0xDEADBEEF && front[20*66 + 14] == 0xDEADBEEF);
+    CHECK(front[19*66 + 10] == 0xDEADBEEF && front[23*66 + 10] == 0xDEADBEEF);
+    CHECK(front[20*66 + 64] == 0xDEADBEEF); // pitch padding untouched
+
+    // Clipped blit reads the matching part of the source
+    uint32_t image[4*4];
+    for(int i = 0; i < 16; i++)
+        image[i] = i;
+    framebuffer.Blit(-2, 46, image, 4, 4, 4);
+    framebuffer.Flush();
+    CHECK(front[46*66 + 0] == 2 && front[47*66 + 1] == 7);
+
+    // 'A' with its 8x8 rows doubled
+    framebuffer.DrawCharacter(8, 0, 'A', 0xFFFFFF, 0x0000AA);
+    CHECK(framebuffer.DamageCount() == 1);
+    framebuffer.Flush();
+    bool glyph = true;
+    for(int y = 0; y < 16; y++)
+        for(int x = 0; x < 8; x++)
+        {
+            bool set = font8x8['A'][y >> 1] & (0x80 >> x);
+            glyph = glyph && front[y*66 + 8 + x] == (set ? 0xFFFFFFu : 0x0000AAu);
+        }
+    CHECK(glyph);
+
+    // The cursor is composited on the way out and never lands in the back buffer
+    framebuffer.MoveCursor(30, 10);
+    framebuffer.ShowCursor(true);
+    framebuffer.Flush();
+    CHECK(front[10*66 + 30] == 0xFF000000); // outline
+    CHECK(front[12*66 + 31] == 0xFFFFFFFF); // fill
+    CHECK(front[10*66 + 32] == 0x000000);   // transparent
+    CHECK(back[10*64 + 30] == 0x000000);
+
+    framebuffer.MoveCursor(60, 40);
+    framebuffer.Flush();
+    CHECK(front[10*66 + 30] == 0x000000);
+    CHECK(front[40*66 + 60] == 0xFF000000);
+    framebuffer.ShowCursor(false);
+    framebuffer.Flush();
+    CHECK(front[40*66 + 60] == 0x000000);
+}
+
+static void TestGraphicsTextScreen()
+{
+    static uint32_t pixels[200*100];
+    static Framebuffer framebuffer(0, 200, 100, 200*4, pixels);
+    uint16_t cells[4*2], drawn[4*2];
+    for(int i = 0; i < 8; i++)
+        cells[i] = 0x0720;
+
+    // 4x2 cells of 8x16 centered on 200x100
+    GraphicsTextScreen text(&framebuffer, cells, drawn, 4, 2);
+    framebuffer.Flush();
+    text.Update();
+    CHECK(framebuffer.DamageCount() == 1);
+    Rectangle r = framebuffer.Damage(0);
+    CHECK(r.x == 84 && r.y == 34 && r.width == 32 && r.height == 32);
+    framebuffer.Flush();
+
+    text.Update();
+    CHECK(framebuffer.DamageCount() == 0);
+
+    cells[5] = 0x1F41; // white 'A' on blue
+    text.Update();
+    CHECK(framebuffer.DamageCount() == 1);
+    r = framebuffer.Damage(0);
+    CHECK(r.x == 92 && r.y == 50 && r.width == 8 && r.height == 16);
+    CHECK(pixels[50*200 + 92] == 0x0000AA);
+}
+
+class EchoServer : public IpcServer {
+    public:
+        uint32_t calls;
+        EchoServer() : calls(0) {}
+        virtual void HandleCall(const IpcMessage& request, IpcMessage* reply)
+        {
+            calls++;
+            reply->label = request.label + 1;
+            for(int i = 0; i < IPC_MESSAGE_WORDS; i++)
+                reply->words[i] = request.words[IPC_MESSAGE_WORDS - 1 - i];
+        }
+};
+
+static void TestIpcEndpoint()
+{
+    static IpcEndpoint endpoint(0);
+    IpcMessage message, received[8];
+
+    // Plain sends never carry a page, whatever the caller left there
+    message.label = 7;
+    message.page = 0x1234000;
+    for(int i = 0; i < 3; i++)
+    {
+        message.words[0] = i;
+        CHECK(endpoint.Send(message));
+    }
+    CHECK(endpoint.Pending(7) != 0 && endpoint.Pending(7)->words[0] == 2);
+    CHECK(endpoint.Pending(8) == 0);
+    CHECK(endpoint.ReceiveBatch(received, 8) == 3);
+    CHECK(received[0].words[0] == 0 && received[2].words[0] == 2);
+    CHECK(received[1].label == 7 && received[1].page == IPC_NO_PAGE);
+    CHECK(endpoint.Pending(7) == 0);
+
+    // Bounded: a full queue rejects and counts
+    bool accepted = true;
+    for(int i = 0; i < IPC_QUEUE_LENGTH; i++)
+        accepted = accepted && endpoint.Send(message);
+    CHECK(accepted);
+    CHECK(!endpoint.Send(message));
+    CHECK(endpoint.Dropped() == 1 && endpoint.Queued() == IPC_QUEUE_LENGTH);
+    uint32_t drained = 0, n;
+    while((n = endpoint.ReceiveBatch(received, 8)) != 0)
+        drained += n;
+    CHECK(drained == IPC_QUEUE_LENGTH);
+
+    // Synchronous calls go straight to the server
+    EchoServer server;
+    IpcMessage reply;
+    message.label = 10;
+    message.words[0] = 1; message.words[1] = 2; message.words[2] = 3; message.words[3] = 4;
+    CHECK(!endpoint.Call(message, &reply));
+    endpoint.Bind(&server);
+    CHECK(endpoint.Call(message, &reply));
+    CHECK(server.calls == 1 && reply.label == 11 && reply.words[0] == 4 && reply.words[3] == 1);
+    CHECK(endpoint.Queued() == 0);
+}
+
+static void TestIpcPageTransfer()
+{
+    static PagingManager paging(0x100000);
+    static IpcEndpoint endpoint(&paging);
+    uint32_t sender = PAGING_SMALL_PAGES;
+    uint32_t receiver = PAGING_SMALL_PAGES + 5*PAGE_SIZE;
+
+    CHECK(paging.MapPage(sender, 0x7000000, PAGE_WRITABLE));
+    IpcMessage message, received;
+    message.label = 3;
+    CHECK(!endpoint.SendPage(&message, receiver)); // nothing mapped there
+    CHECK(!endpoint.SendPage(&message, 0x200000)); // identity mapped 2 MiB page
+    CHECK(paging.Translate(0x200000) == 0x200000 && endpoint.Queued() == 0);
+    CHECK(endpoint.SendPage(&message, sender + 0x10));
+    CHECK(paging.Translate(sender) == MEMORY_NO_FRAME);
+
+    CHECK(endpoint.ReceiveBatch(&received, 1) == 1);
+    CHECK(received.label == 3 && received.page == 0x7000000);
+    CHECK(endpoint.AcceptPage(&received, receiver));
+    CHECK(received.page == IPC_NO_PAGE);
+    CHECK(paging.Translate(receiver + 0x10) == 0x7000010);
+    CHECK(!endpoint.AcceptPage(&received, sender)); // only once
+
+    // A full queue leaves the page with the sender
+    message.label = 4;
+    for(int i = 0; i < IPC_QUEUE_LENGTH; i++)
+        endpoint.Send(message);
+    CHECK(!endpoint.SendPage(&message, receiver));
+    CHECK(paging.Translate(receiver) == 0x7000000);
+    CHECK(endpoint.Dropped() == 1);
+}
+
+static void TestBootTimeline()
+{
+    BootTimeline timeline;
+    CHECK(timeline.Count() == 0);
+    timeline.Checkpoint("loader", 1000000);
+    timeline.Checkpoint("gdt", 1003000);
+    timeline.Checkpoint("ready", 1010000);
+    CHECK(timeline.Count() == 3);
+    CHECK(strcmp(timeline.Name(1), "gdt") == 0 && timeline.Name(3) == 0);
+
+    // 2 GHz: 2000 cycles per microsecond
+    CHECK(timeline.Microseconds(0, 2000000) == 0);
+    CHECK(timeline.Microseconds(2, 2000000) == 5);
+    CHECK(timeline.StageMicroseconds(1, 2000000) == 1);
+    CHECK(timeline.StageMicroseconds(2, 2000000) == 3);
+    CHECK(timeline.Microseconds(2, 0) == 0); // clock not calibrated
+
+    for(int i = 0; i < BOOT_MAX_CHECKPOINTS; i++)
+        timeline.Checkpoint("more");
+    CHECK(timeline.Count() == BOOT_MAX_CHECKPOINTS);
+}
+
+static void TestAtaDriver()
+{
+    hostPortReset();
+    AtaDriver absent(0x1F0, 0x3F6, true);
+    CHECK(!absent.Identify()); // floating bus
+
+    // An LBA48 disk that is always ready with data
+    hostPortReset();
+    hostPortSetDefault(0x1F7, 0x58);
+    hostPortSetDefault(0x1F4, 0);
+    hostPortSetDefault(0x1F5, 0);
+    hostPortSetDefault(0x1F0, 0);
+    hostPortSetDefault(0x3F6, 0x58);
+    for(int i = 0; i < 256; i++)
+        hostPortQueueRead(0x1F0, i == 83 ? 1 << 10 : i == 100 ? 5000 : 0);
+    AtaDriver disk(0x1F0, 0x3F6, true);
+    CHECK(disk.Identify() && disk.SectorCount() == 5000);
+    CHECK(hostPortPendingReads() == 0);
+
+    static uint8_t buffer[300 * BLOCK_SECTOR_SIZE];
+    uint32_t first = hostPortWriteCount();
+    CHECK(disk.Read(10, 300, buffer));
+    uint32_t commands = 0;
+    for(uint32_t i = first; i < hostPortWriteCount(); i++)
+        if(hostPortWritePort(i) == 0x1F7)
+            commands++;
+    CHECK(commands == 1 && hostPortWriteValue(hostPortWriteCount() - 1) == 0x24);
+    CHECK(!disk.Read(4900, 200, buffer));
+
+    // LBA28 caps a command at 256 sectors
+    for(int i = 0; i < 256; i++)
+        hostPortQueueRead(0x1F0, i == 60 ? 5000 : 0);
+    AtaDriver small(0x1F0, 0x3F6, false);
+    CHECK(small.Identify() && small.SectorCount() == 5000);
+    first = hostPortWriteCount();
+    CHECK(small.Read(10, 300, buffer));
+    commands = 0;
+    for(uint32_t i = first; i < hostPortWriteCount(); i++)
+        if(hostPortWritePort(i) == 0x1F7 && hostPortWriteValue(i) == 0x20)
+            commands++;
+    CHECK(commands == 2);
+}
+
+// A disk image in RAM that counts the requests made to it
+class MemoryBlockDevice : public BlockDevice {
+    public:
+        uint8_t* data;
+        uint64_t sectors;
+        uint32_t requests;
+        uint64_t sectorsRead;
+
+        MemoryBlockDevice(uint8_t* data, uint64_t sectors)
+        : data(data), sectors(sectors), requests(0), sectorsRead(0) {}
+
+        virtual bool Read(uint64_t sector, uint32_t count, void* buffer)
+        {
+            if(sector + count > sectors)
+                return false;
+            requests++;
+            sectorsRead += count;
+            memcpy(buffer, data + sector * BLOCK_SECTOR_SIZE, count * BLOCK_SECTOR_SIZE);
+            return true;
+        }
+
+        virtual uint64_t SectorCount()
+        {
+            return sectors;
+        }
+};
+
+// 24 reserved sectors, two FATs of 8 sectors, 1000 clusters of one sector
+#define IMAGE_FAT0 (24 * BLOCK_SECTOR_SIZE)
+#define IMAGE_FAT1 (32 * BLOCK_SECTOR_SIZE)
+#define IMAGE_VOLUME_SECTORS 1040
+#define IMAGE_PARTITION_START 63
+#define IMAGE_LONG_FILE_SIZE (20 * 512 - 100)
+
+static uint8_t diskImage[(IMAGE_PARTITION_START + IMAGE_VOLUME_SECTORS) * BLOCK_SECTOR_SIZE];
+static uint32_t fatCache[1024];
+
+static void put16(uint8_t* p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t value)
+{
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+static uint8_t* imageCluster(uint8_t* volume, uint32_t cluster)
+{
+    return volume + (40 + cluster - 2) * BLOCK_SECTOR_SIZE;
+}
+
+static uint8_t* putEntry(uint8_t* entry, const char* shortName, uint8_t attributes, uint8_t caseFlags, uint32_t cluster, uint32_t size)
+{
+    memset(entry, 0, 32);
+    memcpy(entry, shortName, 11);
+    entry[11] = attributes;
+    entry[12] = caseFlags;
+    put16(entry + 20, cluster >> 16);
+    put16(entry + 26, cluster);
+    put32(entry + 28, size);
+    return entry + 32;
+}
+
+// Long name entries for name, checksummed against shortName
+static uint8_t* putLongName(uint8_t* entry, const char* name, const char* shortName)
+{
+    static const uint8_t offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    uint8_t checksum = 0;
+    for(int i = 0; i < 11; i++)
+        checksum = ((checksum & 1) << 7) + (checksum >> 1) + (uint8_t)shortName[i];
+
+    uint32_t length = strlen(name);
+    uint32_t count = (length + 12) / 13;
+    for(uint32_t ordinal = count; ordinal >= 1; ordinal--, entry += 32)
+    {
+        memset(entry, 0, 32);
+        entry[0] = ordinal | (ordinal == count ? 0x40 : 0);
+        entry[11] = FAT_ATTRIBUTE_LONG_NAME;
+        entry[13] = checksum;
+        for(uint32_t i = 0; i < 13; i++)
+        {
+            uint32_t k = (ordinal - 1) * 13 + i;
+            put16(entry + offsets[i], k < length ? name[k] : k == length ? 0x0000 : 0xFFFF);
+        }
+    }
+    return entry;
+}
+
+static void putFile(uint8_t* volume, const uint32_t* clusters, uint32_t count, uint32_t size, uint8_t seed)
+{
+    uint8_t* fat = volume + IMAGE_FAT1;
+    for(uint32_t i = 0; i < count; i++)
+        put32(fat + clusters[i] * 4, i + 1 < count ? clusters[i + 1] : 0x0FFFFFFF);
+    for(uint32_t offset = 0; offset < size; offset++)
+        imageCluster(volume, clusters[offset / 512])[offset % 512] = offset * 7 + seed;
+}
+
+static bool checkContent(const uint8_t* data, uint32_t offset, uint32_t count, uint8_t seed)
+{
+    for(uint32_t i = 0; i < count; i++)
+        if(data[i] != (uint8_t)((offset + i) * 7 + seed))
+            return false;
+    return true;
+}
+
+static void buildFatImage(uint8_t* volume)
+{
+    memset(volume, 0, IMAGE_VOLUME_SECTORS * BLOCK_SECTOR_SIZE);
+    volume[0] = 0xEB; volume[1] = 0x58; volume[2] = 0x90;
+    put16(volume + 11, 512);
+    volume[13] = 1;
+    put16(volume + 14, 24);
+    volume[16] = 2;
+    volume[21] = 0xF8;
+    put32(volume + 32, IMAGE_VOLUME_SECTORS);
+    put32(volume + 36, 8);
+    put32(volume + 44, 2);
+    put16(volume + 510, 0xAA55);
+    put32(volume + IMAGE_FAT1, 0x0FFFFFF8);
+    put32(volume + IMAGE_FAT1 + 4, 0x0FFFFFFF);
+
+    static const uint32_t root[] = { 2, 3 };
+    static const uint32_t readme[] = { 4, 5 };
+    static const uint32_t docs[] = { 6 };
+    static const uint32_t notes[] = { 7 };
+    static const uint32_t bad[] = { 8 };
+    // Three fragments, the last one physically before the second
+    uint32_t fragmented[20];
+    for(uint32_t i = 0; i < 10; i++) fragmented[i] = 10 + i;
+    for(uint32_t i = 0; i < 5; i++) fragmented[10 + i] = 30 + i;
+    for(uint32_t i = 0; i < 5; i++) fragmented[15 + i] = 20 + i;
+
+    putFile(volume, root, 2, 0, 0);
+    putFile(volume, readme, 2, 600, 1);
+    putFile(volume, fragmented, 20, IMAGE_LONG_FILE_SIZE, 2);
+    putFile(volume, docs, 1, 0, 0);
+    putFile(volume, notes, 1, 100, 3);
+    putFile(volume, bad, 1, 10, 4);
+
+    uint8_t* entry = imageCluster(volume, 2);
+    entry = putEntry(entry, "ARCHANGEL  ", FAT_ATTRIBUTE_VOLUME_ID, 0, 0, 0);
+    entry = putEntry(entry, "README  TXT", FAT_ATTRIBUTE_ARCHIVE, 0x18, 4, 600);
+    entry = putLongName(entry, "A long file name.data", "ALONGF~1DAT");
+    entry = putEntry(entry, "ALONGF~1DAT", FAT_ATTRIBUTE_ARCHIVE, 0, 10, IMAGE_LONG_FILE_SIZE);
+    entry = putEntry(entry, "DOCS       ", FAT_ATTRIBUTE_DIRECTORY, 0x08, 6, 0);
+    // Deleted entries up to the end of the first root cluster
+    while(entry < imageCluster(volume, 3))
+    {
+        entry = putEntry(entry, "GONE    TXT", FAT_ATTRIBUTE_ARCHIVE, 0, 9, 5);
+        entry[-32] = 0xE5;
+    }
+    entry = putLongName(entry, "Bad checksum name", "OTHER   TXT");
+    entry = putEntry(entry, "BADLFN  TXT", FAT_ATTRIBUTE_ARCHIVE, 0, 8, 10);
+
+    entry = imageCluster(volume, 6);
+    entry = putEntry(entry, ".          ", FAT_ATTRIBUTE_DIRECTORY, 0, 6, 0);
+    entry = putEntry(entry, "..         ", FAT_ATTRIBUTE_DIRECTORY, 0, 0, 0);
+    entry = putLongName(entry, "Meeting notes.txt", "MEETIN~1TXT");
+    entry = putEntry(entry, "MEETIN~1TXT", FAT_ATTRIBUTE_ARCHIVE, 0, 7, 100);
+
+    // Mirrored
+    memcpy(volume + IMAGE_FAT0, volume + IMAGE_FAT1, IMAGE_FAT1 - IMAGE_FAT0);
+}
+
+static void TestFat32Lookup()
+{
+    buildFatImage(diskImage);
+    MemoryBlockDevice disk(diskImage, IMAGE_VOLUME_SECTORS);
+    FatFileSystem small(&disk, fatCache, 512);
+    CHECK(!small.Mount()); // the FAT doesn't fit
+
+    disk.requests = 0;
+    disk.sectorsRead = 0;
+    FatFileSystem fs(&disk, fatCache, 1024);
+    CHECK(fs.Mount());
+    CHECK(disk.requests == 2 && disk.sectorsRead == 9); // boot sector, whole FAT
+    CHECK(fs.ClusterSize() == 512 && fs.ClusterCount() == 1000);
+
+    // Volume label, deleted entries and long name parts are not listed
+    static FatFile root, file;
+    FatDirectoryEntry entry;
+    const char* expected[] = { "readme.txt", "A long file name.data", "docs", "BADLFN.TXT" };
+    uint32_t count = 0;
+    bool ordered = true;
+    CHECK(fs.Open("/", &root) && root.IsDirectory() && root.Size() == 2 * 512);
+    while(fs.ReadDirectory(&root, &entry))
+    {
+        ordered = ordered && count < 4 && strcmp(entry.name, expected[count]) == 0;
+        count++;
+    }
+    CHECK(count == 4 && ordered);
+    CHECK(!fs.ReadDirectory(&root, &entry));
+
+    uint8_t buffer[1024];
+    CHECK(fs.Open("README.TXT", &file) && !file.IsDirectory() && file.Size() == 600);
+    CHECK(file.Read(buffer, sizeof(buffer)) == 600 && checkContent(buffer, 0, 600, 1));
+    CHECK(file.Read(buffer, 1) == 0);
+
+    CHECK(fs.Open("/docs/meeting NOTES.txt", &file) && file.Size() == 100);
+    CHECK(file.Read(buffer, sizeof(buffer)) == 100 && checkContent(buffer, 0, 100, 3));
+    CHECK(fs.Open("//docs/../badlfn.txt", &file) && file.Size() == 10);
+    CHECK(file.Read(buffer, sizeof(buffer)) == 10 && checkContent(buffer, 0, 10, 4));
+
+    CHECK(!fs.Open("/missing", &file));
+    CHECK(!fs.Open("/readme.txt/more", &file));
+    CHECK(!fs.Open("/docs/Meeting", &file));
+    CHECK(!fs.Open("/Bad checksum name", &file));
+}
+
+static void TestFat32Extents()
+{
+    buildFatImage(diskImage);
+    MemoryBlockDevice disk(diskImage, IMAGE_VOLUME_SECTORS);
+    FatFileSystem fs(&disk, fatCache, 1024);
+    static FatFile file;
+    static uint8_t buffer[20 * 512];
+    CHECK(fs.Mount());
+    CHECK(fs.Open("/A long file name.data", &file));
+    CHECK(file.ExtentCount() == 3 && file.Size() == IMAGE_LONG_FILE_SIZE);
+
+    // One request per extent, plus the partial last sector
+    disk.requests = 0;
+    disk.sectorsRead = 0;
+    CHECK(file.Read(buffer, sizeof(buffer)) == IMAGE_LONG_FILE_SIZE);
+    CHECK(checkContent(buffer, 0, IMAGE_LONG_FILE_SIZE, 2));
+    CHECK(disk.requests == 4 && disk.sectorsRead == 20);
+
+    // Seeks land in the right extent without going back to the FAT
+    disk.requests = 0;
+    CHECK(file.Seek(12 * 512 + 3));
+    CHECK(file.Read(buffer, 1000) == 1000 && checkContent(buffer, 12 * 512 + 3, 1000, 2));
+    CHECK(disk.requests == 2 && file.Position() == 12 * 512 + 1003);
+    CHECK(file.Seek(15 * 512 - 10));
+    CHECK(file.Read(buffer, 20) == 20 && checkContent(buffer, 15 * 512 - 10, 20, 2));
+    CHECK(!file.Seek(IMAGE_LONG_FILE_SIZE + 1));
+    CHECK(file.Seek(IMAGE_LONG_FILE_SIZE) && file.Read(buffer, 1) == 0);
+
+    // A chain that loops back on itself is refused
+    put32(diskImage + IMAGE_FAT0 + 24 * 4, 10);
+    FatFileSystem looped(&disk, fatCache, 1024);
+    CHECK(looped.Mount());
+    CHECK(!looped.Open("/A long file name.data", &file));
+}
+
+static void TestFat32ActiveFat()
+{
+    // Mirroring off (bit 7) with FAT #1 active, and FAT #0 stale
+    buildFatImage(diskImage);
+    memset(diskImage + IMAGE_FAT0, 0, IMAGE_FAT1 - IMAGE_FAT0);
+    put16(diskImage + 40, 0x81);
+    MemoryBlockDevice disk(diskImage, IMAGE_VOLUME_SECTORS);
+    static FatFile file;
+    static uint8_t buffer[20 * 512];
+    FatFileSystem fs(&disk, fatCache, 1024);
+    CHECK(fs.Mount());
+    CHECK(fs.Open("/A long file name.data", &file) && file.ExtentCount() == 3);
+    CHECK(file.Read(buffer, sizeof(buffer)) == IMAGE_LONG_FILE_SIZE);
+    CHECK(checkContent(buffer, 0, IMAGE_LONG_FILE_SIZE, 2));
+
+    // The bits 0-3 only count when mirroring is off
+    put16(diskImage + 40, 0x01);
+    FatFileSystem mirrored(&disk, fatCache, 1024);
+    CHECK(mirrored.Mount());
+    CHECK(!mirrored.Open("/A long file name.data", &file));
+
+    put16(diskImage + 40, 0x82); // there is no FAT #2
+    FatFileSystem missing(&disk, fatCache, 1024);
+    CHECK(!missing.Mount());
+}
+
+static void TestFat32Partition()
+{
+    memset(diskImage, 0, IMAGE_PARTITION_START * BLOCK_SECTOR_SIZE);
+    buildFatImage(diskImage + IMAGE_PARTITION_START * BLOCK_SECTOR_SIZE);
+    uint8_t* partition = diskImage + 446;
+    partition[4] = 0x0C;
+    put32(partition + 8, IMAGE_PARTITION_START);
+    put32(partition + 12, IMAGE_VOLUME_SECTORS);
+    put16(diskImage + 510, 0xAA55);
+
+    MemoryBlockDevice disk(diskImage, IMAGE_PARTITION_START + IMAGE_VOLUME_SECTORS);
+    FatFileSystem fs(&disk, fatCache, 1024);
+    static FatFile file;
+    uint8_t buffer[128];
+    CHECK(fs.Mount());
+    CHECK(fs.Open("/docs/Meeting notes.txt", &file));
+    CHECK(file.Read(buffer, sizeof(buffer)) == 100 && checkContent(buffer, 0, 100, 3));
+
+    partition[4] = 0x83; // not FAT32
+    FatFileSystem other(&disk, fatCache, 1024);
+    CHECK(!other.Mount());
+}
+
+
+typedef void (*TestFunction)();
+
+struct TestCase {
+    const char* name;
+    TestFunction run;
+};
+
+static TestCase tests[] = {
+    { "gdt segment descriptor", TestSegmentDescriptor },
+    { "ring buffer", TestRingBuffer },
+    { "scancode decoder", TestScancodeDecoder },
+    { "input queue coalescing", TestInputQueueCoalescing },
+    { "keyboard driver", TestKeyboardDriver },
+    { "mouse driver", TestMouseDriver },
+    { "ps/2 activation", TestPs2Activation },
+    { "terminal scrollback", TestTerminalScrollback },
+    { "terminal manager", TestTerminalManager },
+    { "timer wheel", TestTimerWheel },
+    { "physical memory", TestPhysicalMemory },
+    { "fpu lazy switching", TestFloatingPointUnit },
+    { "pixel kernels", TestPixelKernels },
+    { "framebuffer damage", TestFramebufferDamage },
+    { "framebuffer flush", TestFramebufferFlush },
+    { "graphics text screen", TestGraphicsTextScreen },
+    { "ipc endpoint", TestIpcEndpoint },
+    { "ipc page transfer", TestIpcPageTransfer },
+    { "boot timeline", TestBootTimeline },
+    { "ata pio", TestAtaDriver },
+    { "fat32 lookup", TestFat32Lookup },
+    { "fat32 extents", TestFat32Extents },
+    { "fat32 active fat", TestFat32ActiveFat },
+    { "fat32 partition", TestFat32Partition },
+};
+
+int main()
+{
+    for(uint32_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        int before = failures;
+        tests[i].run();
+        printf("%s %s\n", failures == before ? "PASS" : "FAIL", tests[i].name);
+    }
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include "input.h"
+#include "cpu.h"
+
+// Reinterprets an event as message words without tripping aliasing rules
+union InputMessage {
+    InputEvent event;
+    uint32_t words[IPC_MESSAGE_WORDS];
+};
+
+static void pack(const InputEvent& event, IpcMessage* message)
+{
+    InputMessage packed;
+    packed.event = event;
+    message->label = IPC_LABEL_INPUT;
+    for(uint32_t i = 0; i < IPC_MESSAGE_WORDS; i++)
+        message->words[i] = packed.words[i];
+}
+
+
+InputEventQueue::InputEventQueue()
+: endpoint(0)
+{
+}
+
+InputEventQueue::~InputEventQueue()
+{
+}
+
+void InputEventQueue::Post(InputEvent& event)
+{
+    event.timestamp = readTimestampCounter();
+    IpcMessage message;
+    pack(event, &message);
+    endpoint.Send(message);
+}
+
+// Newest unconsumed event if it is of this type, copied to *event
+IpcMessage* InputEventQueue::Pending(uint8_t type, InputEvent* event)
+{
+    IpcMessage* message = endpoint.Pending(IPC_LABEL_INPUT);
+    if(message == 0 || !Decode(*message, event) || event->type != type)
+        return 0;
+    return message;
+}
+
+void InputEventQueue::PostKey(uint8_t type, uint8_t code, char ascii, uint8_t modifiers)
+{
+    InputEvent event;
+    event.type = type;
+    event.modifiers = modifiers;
+    event.code = code;
+    event.ascii = ascii;
+    event.dx = 0;
+    event.dy = 0;
+    Post(event);
+}
+
+void InputEventQueue::PostMouseMove(int dx, int dy)
+{
+    // Motion the consumer has not picked up yet is folded into one event,
+    // so a busy consumer sees at most one move between two other events.
+    InputEvent newest;
+    IpcMessage* pending = Pending(INPUT_MOUSE_MOVE, &newest);
+    if(pending != 0
+    && -0x7000 < newest.dx && newest.dx < 0x7000
+    && -0x7000 < newest.dy && newest.dy < 0x7000)
+    {
+        newest.dx += dx;
+        newest.dy += dy;
+        newest.timestamp = readTimestampCounter();
+        pack(newest, pending);
+        return;
+    }
+
+    InputEvent event;
+    event.type = INPUT_MOUSE_MOVE;
+    event.modifiers = 0;
+    event.code = 0;
+    event.ascii = 0;
+    event.dx = dx;
+    event.dy = dy;
+    Post(event);
+}
+
+void InputEventQueue::PostMouseButton(uint8_t type, uint8_t button)
+{
+    InputEvent event;
+    event.type = type;
+    event.modifiers = 0;
+    event.code = button;
+    event.ascii = 0;
+    event.dx = 0;
+    event.dy = 0;
+    Post(event);
+}
+
+void InputEventQueue::PostMouseWheel(int dz)
+{
+    InputEvent newest;
+    IpcMessage* pending = Pending(INPUT_MOUSE_WHEEL, &newest);
+    if(pending != 0 && -0x7000 < newest.dy && newest.dy < 0x7000)
+    {
+        newest.dy += dz;
+        newest.timestamp = readTimestampCounter();
+        pack(newest, pending);
+        return;
+    }
+
+    InputEvent event;
+    event.type = INPUT_MOUSE_WHEEL;
+    event.modifiers = 0;
+    event.code = 0;
+    event.ascii = 0;
+    event.dx = 0;
+    event.dy = dz;
+    Post(event);
+}
+
+void InputEventQueue::WaitEvent(InputEvent* event)
+{
+    IpcMessage message;
+    do
+        endpoint.Receive(&message);
+    while(!Decode(message, event));
+}
+
+uint32_t InputEventQueue::PollEvents(InputEvent* buffer, uint32_t count)
+{
+    IpcMessage messages[32];
+    uint32_t n = 0;
+    while(n < count)
+    {
+        uint32_t batch = count - n < 32 ? count - n : 32;
+        uint32_t received = endpoint.ReceiveBatch(messages, batch);
+        for(uint32_t i = 0; i < received; i++)
+            if(Decode(messages[i], &buffer[n]))
+                n++;
+        if(received < batch)
+            break;
+    }
+    return n;
+}
+
+uint32_t InputEventQueue::Dropped()
+{
+    return endpoint.Dropped();
+}
+
+IpcEndpoint* InputEventQueue::Endpoint()
+{
+    return &endpoint;
+}
+
+bool InputEventQueue::Decode(const IpcMessage& message, InputEvent* event)
+{
+    if(message.label != IPC_LABEL_INPUT)
+        return false;
+    InputMessage packed;
+    for(uint32_t i = 0; i < IPC_MESSAGE_WORDS; i++)
+        packed.words[i] = message.words[i];
+    *event = packed.event;
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include "types.h"
+#include "ipc.h"
+
+enum InputEventType {
+    INPUT_KEY_DOWN = 1,
+    INPUT_KEY_UP,
+    INPUT_MOUSE_MOVE,
+    INPUT_MOUSE_DOWN,
+    INPUT_MOUSE_UP,
+    INPUT_MOUSE_WHEEL
+};
+
+enum InputModifier {
+    INPUT_MOD_SHIFT    = 0x01,
+    INPUT_MOD_CTRL     = 0x02,
+    INPUT_MOD_ALT      = 0x04,
+    INPUT_MOD_CAPSLOCK = 0x08
+};
+
+struct InputEvent {
+    uint64_t timestamp; // TSC at the time the driver queued it
+    uint8_t type;       // InputEventType
+    uint8_t modifiers;  // InputModifier bits held at the time
+    uint8_t code;       // keycode (see keyboard.h) or mouse button 1..3
+    char ascii;         // 0 when the key has no printable character
+    int16_t dx;         // mouse move: x delta
+    int16_t dy;         // mouse move: y delta, mouse wheel: scroll amount
+} __attribute__((packed));
+
+
+// Input events travel as IPC_LABEL_INPUT messages, the 16-byte event
+// packed into the four message words. The drivers post from interrupt
+// context; a consumer either uses WaitEvent/PollEvents or receives from
+// Endpoint() directly and unpacks with Decode().
+class InputEventQueue {
+    IpcEndpoint endpoint;
+
+    void Post(InputEvent& event);
+    IpcMessage* Pending(uint8_t type, InputEvent* event);
+
+    public:
+        InputEventQueue();
+        ~InputEventQueue();
+
+        // Producers, called by the drivers from interrupt context
+        void PostKey(uint8_t type, uint8_t code, char ascii, uint8_t modifiers);
+        void PostMouseMove(int dx, int dy);
+        void PostMouseButton(uint8_t type, uint8_t button);
+        void PostMouseWheel(int dz);
+
+        // Halts the CPU until an event is available, then returns it
+        void WaitEvent(InputEvent* event);
+        // Copies up to count queued events without blocking, returns how many
+        uint32_t PollEvents(InputEvent* buffer, uint32_t count);
+
+        uint32_t Dropped();
+        IpcEndpoint* Endpoint();
+
+        static bool Decode(const IpcMessage& message, InputEvent* event);
+};
+
+#endif // !__INPUT_H
@@ -1,6 +1,7 @@
 #include "interrupts.h"
 #include "gdt.h"
 #include "port.h"
+#include "cpu.h"
 
 
 InterruptHandler::InterruptHandler(uint8_t interruptNumber, InterruptManager* interruptManager){
@@ -48,11 +49,21 @@ InterruptManager::InterruptManager(GlobalDescriptorTable* globalDescriptorTable)
      uint32_t CodeSegment = globalDescriptorTable->CodeSegmentSelector();
 
      const uint8_t IDT_INTERRUPT_GATE = 0xE;
-     for (uint8_t i = 255; i > 0; --i) {
+
+     // Gate descriptors split the handler address in two halves, which
+     // neither the compiler nor ld can produce for a static table. Encode
+     // the default gate once and replicate it to all 256 vectors instead.
+     SetInterruptDescriptorTableEntry(0, CodeSegment, &IgnoreInterruptRequest, 0, IDT_INTERRUPT_GATE);
+     GateDescriptor ignore = InterruptDescriptorTable[0];
+     for (uint32_t i = 0; i < 256; i++) {
          handler[i] = 0;
-         SetInterruptDescriptorTableEntry(i, CodeSegment, &IgnoreInterruptRequest, 0, IDT_INTERRUPT_GATE);
+         InterruptDescriptorTable[i] = ignore;
      }
 
+     SetInterruptDescriptorTableEntry(0x07, CodeSegment, &HandleException0x07, 0, IDT_INTERRUPT_GATE);
+     SetInterruptDescriptorTableEntry(0x08, CodeSegment, &HandleException0x08, 0, IDT_INTERRUPT_GATE);
+     SetInterruptDescriptorTableEntry(0x0D, CodeSegment, &HandleException0x0D, 0, IDT_INTERRUPT_GATE);
+     SetInterruptDescriptorTableEntry(0x0E, CodeSegment, &HandleException0x0E, 0, IDT_INTERRUPT_GATE);
      SetInterruptDescriptorTableEntry(0x20, CodeSegment, &HandleInterruptRequest0x00, 0, IDT_INTERRUPT_GATE);
      SetInterruptDescriptorTableEntry(0x21, CodeSegment, &HandleInterruptRequest0x01, 0, IDT_INTERRUPT_GATE);
      SetInterruptDescriptorTableEntry(0x2C, CodeSegment, &HandleInterruptRequest0x0C, 0, IDT_INTERRUPT_GATE);
@@ -113,10 +124,45 @@ extern "C" uint32_t handleInterrupt(uint8_t interruptNumber, uint32_t esp) {
 
 extern "C" void printf(const char* str);
 
+static void printfHex32(uint32_t value) {
+    const char* hex = "0123456789ABCDEF";
+    char foo[] = "0x00000000";
+    for (int i = 0; i < 8; i++)
+        foo[9 - i] = hex[(value >> (4*i)) & 0x0F];
+    printf(foo);
+}
+
+// Returning from these would re-run the faulting instruction forever, and
+// the default gate's bare iret cannot pop their error code. Report, stop.
+static void fatalException(uint8_t interruptNumber, uint32_t esp) {
+    uint32_t* frame = (uint32_t*)esp; // eax..ebp, error code, eip, cs, eflags
+    if (interruptNumber == 0x0E) {
+        printf("\nPAGE FAULT at ");
+        printfHex32(readCR2());
+    }
+    else if (interruptNumber == 0x0D) {
+        printf("\nGENERAL PROTECTION FAULT");
+    }
+    else {
+        printf("\nDOUBLE FAULT");
+    }
+    printf(" error ");
+    printfHex32(frame[7]);
+    printf(" eip ");
+    printfHex32(frame[8]);
+    printf("\n");
+
+    while (1)
+        asm volatile("cli; hlt");
+}
+
 uint32_t InterruptManager::DoHandleInterrupt(uint8_t interruptNumber, uint32_t esp) {
     if (handler[interruptNumber] != 0) {
         esp = handler[interruptNumber] -> HandleInterrupt(esp);
     }
+    else if (interruptNumber == 0x08 || interruptNumber == 0x0D || interruptNumber == 0x0E) {
+        fatalException(interruptNumber, esp);
+    }
     else if (interruptNumber != 0x20) {
         char foo[] = "UNHANDLED INTERRUPT 0x00";
         const char* hex = "0123456789ABCDEF";
@@ -16,7 +16,7 @@ class InterruptHandler {
         ~InterruptHandler();
 
     public:
-        uint32_t HandleInterrupt(uint32_t esp);
+        virtual uint32_t HandleInterrupt(uint32_t esp);
 };
 
 class InterruptManager {
@@ -65,6 +65,10 @@ class InterruptManager {
         uint32_t DoHandleInterrupt(uint8_t interruptNumber, uint32_t esp);
 
         static void IgnoreInterruptRequest();
+        static void HandleException0x07(); // Device not available (#NM)
+        static void HandleException0x08(); // Double fault (#DF)
+        static void HandleException0x0D(); // General protection (#GP)
+        static void HandleException0x0E(); // Page fault (#PF)
         static void HandleInterruptRequest0x00(); // Timeout interrupt
         static void HandleInterruptRequest0x01(); // Keyboard interrupt
         static void HandleInterruptRequest0x0C(); // Mouse interrupt
@@ -8,13 +8,23 @@
 
 
 .macro HandleException num
-.global _ZN16InterruptManager16HandleException\num\()Ev
-_ZN16InterruptManager16HandleException\num\()Ev:
+.global _ZN16InterruptManager19HandleException\num\()Ev
+_ZN16InterruptManager19HandleException\num\()Ev:
     movb $\num, (interruptnumber)
     jmp int_bottom
 .endm
 
 
+# For exceptions where the CPU pushes no error code
+.macro HandleExceptionNoErrorCode num
+.global _ZN16InterruptManager19HandleException\num\()Ev
+_ZN16InterruptManager19HandleException\num\()Ev:
+    movb $\num, (interruptnumber)
+    pushl $0
+    jmp int_bottom
+.endm
+
+
 .macro HandleInterruptRequest num
 .global _ZN16InterruptManager26HandleInterruptRequest\num\()Ev
 _ZN16InterruptManager26HandleInterruptRequest\num\()Ev:
@@ -24,6 +34,11 @@ _ZN16InterruptManager26HandleInterruptRequest\num\()Ev:
 .endm
 
 
+HandleExceptionNoErrorCode 0x07
+HandleException 0x08
+HandleException 0x0D
+HandleException 0x0E
+
 HandleInterruptRequest 0x00
 HandleInterruptRequest 0x01
 HandleInterruptRequest 0x02
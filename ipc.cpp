@@ -0,0 +1,136 @@
+#include "ipc.h"
+#include "cpu.h"
+
+
+IpcServer::IpcServer()
+{
+}
+
+IpcServer::~IpcServer()
+{
+}
+
+void IpcServer::HandleCall(const IpcMessage& /*request*/, IpcMessage* reply)
+{
+    reply->label = 0;
+    reply->page = IPC_NO_PAGE;
+}
+
+
+IpcEndpoint::IpcEndpoint(PagingManager* paging)
+{
+    this->paging = paging;
+    server = 0;
+    dropped = 0;
+}
+
+IpcEndpoint::~IpcEndpoint()
+{
+}
+
+void IpcEndpoint::Bind(IpcServer* server)
+{
+    this->server = server;
+}
+
+bool IpcEndpoint::Call(const IpcMessage& request, IpcMessage* reply)
+{
+    if(server == 0)
+        return false;
+    server->HandleCall(request, reply);
+    return true;
+}
+
+bool IpcEndpoint::Send(const IpcMessage& message)
+{
+    // Senders in thread and IRQ context share the producer end
+    uint32_t flags = disableInterrupts();
+    IpcMessage* slot = queue.Reserve();
+    if(slot != 0)
+    {
+        slot->label = message.label;
+        for(uint32_t i = 0; i < IPC_MESSAGE_WORDS; i++)
+            slot->words[i] = message.words[i];
+        slot->page = IPC_NO_PAGE; // only SendPage() hands over pages
+        queue.Commit();
+    }
+    else
+    {
+        dropped++;
+    }
+    restoreInterrupts(flags);
+    return slot != 0;
+}
+
+bool IpcEndpoint::SendPage(IpcMessage* message, uint32_t address)
+{
+    // Only 4 KiB mappings move. Unmapping a 2 MiB page of the identity
+    // map would take the kernel code and data around it along.
+    if(paging == 0 || !paging->IsSmallPage(address))
+        return false;
+
+    uint64_t physical = paging->Translate(address);
+    if(physical == MEMORY_NO_FRAME)
+        return false;
+
+    uint32_t flags = disableInterrupts();
+    bool sent = !queue.Full();
+    if(sent)
+    {
+        paging->UnmapPage(address);
+        message->page = physical & ~(uint64_t)(PAGE_SIZE - 1);
+        queue.Push(*message);
+    }
+    else
+    {
+        dropped++;
+    }
+    restoreInterrupts(flags);
+    return sent;
+}
+
+IpcMessage* IpcEndpoint::Pending(uint32_t label)
+{
+    IpcMessage* newest = queue.Newest();
+    if(newest == 0 || newest->label != label)
+        return 0;
+    return newest;
+}
+
+void IpcEndpoint::Receive(IpcMessage* message)
+{
+    uint32_t flags = disableInterrupts();
+    while(!queue.Pop(message))
+        waitForInterrupt();
+    restoreInterrupts(flags);
+}
+
+uint32_t IpcEndpoint::ReceiveBatch(IpcMessage* buffer, uint32_t count)
+{
+    uint32_t flags = disableInterrupts();
+    uint32_t i = 0;
+    while(i < count && queue.Pop(&buffer[i]))
+        i++;
+    restoreInterrupts(flags);
+    return i;
+}
+
+bool IpcEndpoint::AcceptPage(IpcMessage* message, uint32_t address)
+{
+    if(paging == 0 || message->page == IPC_NO_PAGE)
+        return false;
+    if(!paging->MapPage(address, message->page, PAGE_WRITABLE | PAGE_NO_EXECUTE))
+        return false;
+    message->page = IPC_NO_PAGE;
+    return true;
+}
+
+uint32_t IpcEndpoint::Queued()
+{
+    return queue.Count();
+}
+
+uint32_t IpcEndpoint::Dropped()
+{
+    return dropped;
+}
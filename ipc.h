@@ -0,0 +1,73 @@
+#ifndef __IPC_H
+#define __IPC_H
+
+#include "types.h"
+#include "ringbuffer.h"
+#include "paging.h"
+
+#define IPC_MESSAGE_WORDS 4
+#define IPC_QUEUE_LENGTH 256
+#define IPC_NO_PAGE MEMORY_NO_FRAME
+
+// Message labels
+#define IPC_LABEL_INPUT 1
+
+// A label and four words, small enough to be handed over in registers.
+// One 4 KiB page may ride along: it is unmapped from the sender and mapped
+// into the receiver, never copied.
+struct IpcMessage {
+    uint32_t label;
+    uint32_t words[IPC_MESSAGE_WORDS];
+    uint64_t page; // physical address of a transferred page, or IPC_NO_PAGE
+};
+
+
+// Receiving side of synchronous calls
+class IpcServer {
+    public:
+        IpcServer();
+        ~IpcServer();
+        virtual void HandleCall(const IpcMessage& request, IpcMessage* reply);
+};
+
+
+// Message endpoint. Send() is asynchronous and may be called from
+// interrupt context; the queue is bounded and a full queue rejects the
+// message instead of blocking the sender. Call() is synchronous and runs
+// the bound server right away, without going through the queue.
+class IpcEndpoint {
+    RingBuffer<IpcMessage, IPC_QUEUE_LENGTH> queue;
+    IpcServer* server;
+    PagingManager* paging; // 0 when pages cannot be transferred
+    uint32_t dropped;
+
+    public:
+        IpcEndpoint(PagingManager* paging);
+        ~IpcEndpoint();
+
+        void Bind(IpcServer* server);
+        bool Call(const IpcMessage& request, IpcMessage* reply);
+
+        bool Send(const IpcMessage& message);
+        // Sends the page mapped at address along with the message. It is
+        // unmapped on success and stays with the sender otherwise. Only
+        // 4 KiB mappings can be sent, not the 2 MiB identity map.
+        bool SendPage(IpcMessage* message, uint32_t address);
+
+        // The newest message if it has not been received yet and carries
+        // this label, so a producer can fold an update into it. Producer
+        // side only.
+        IpcMessage* Pending(uint32_t label);
+
+        // Halts the CPU until a message arrives
+        void Receive(IpcMessage* message);
+        // Takes up to count queued messages without blocking
+        uint32_t ReceiveBatch(IpcMessage* buffer, uint32_t count);
+        // Maps a received page at address
+        bool AcceptPage(IpcMessage* message, uint32_t address);
+
+        uint32_t Queued();
+        uint32_t Dropped();
+};
+
+#endif // !__IPC_H
@@ -3,61 +3,59 @@
 #include "interrupts.h"
 #include "keyboard.h"
 #include "mouse.h"
+#include "input.h"
+#include "terminal.h"
+#include "clock.h"
+#include "multiboot.h"
+#include "memory.h"
+#include "paging.h"
+#include "graphics.h"
+#include "fpu.h"
+#include "boot.h"
+#include "ata.h"
+#include "fat32.h"
+#include "cpu.h"
+
+#define NUM_TERMINALS 4
+#define TERMINAL_SCROLLBACK_LINES 1000
 
-// Global variables for cursor position
 static uint16_t* VideoMemory = (uint16_t*)0xb8000;
-static int x=0, y=0;
 
-void clearScreen(){
-    for(y = 0; y < 25; y++){
-        for(x = 0; x < 80; x++){
-            // 0x0720 is White-on-Black (0x07) attribute with a space character (0x20)
-            VideoMemory[80*y + x] = 0x0720;
-        }
-    }
-    // Reset cursor position to top-left
-    x = 0;
-    y = 0;
-}
+// Terminal 0 is the kernel console that printf writes to. The others only
+// live in RAM until Alt+F2..F4 brings them on screen.
+static char scrollback[NUM_TERMINALS][TERMINAL_SCROLLBACK_LINES][TERMINAL_COLUMNS];
+static VirtualTerminal terminals[NUM_TERMINALS] = {
+    VirtualTerminal(scrollback[0][0], TERMINAL_SCROLLBACK_LINES),
+    VirtualTerminal(scrollback[1][0], TERMINAL_SCROLLBACK_LINES),
+    VirtualTerminal(scrollback[2][0], TERMINAL_SCROLLBACK_LINES),
+    VirtualTerminal(scrollback[3][0], TERMINAL_SCROLLBACK_LINES)
+};
 
-extern "C" void printf(const char* str){
-    for (int i = 0; str[i] != '\0' ; ++i) {
-        char character = str[i];
-
-        switch(character){
-            case '\n':
-                y++; // Move to next line
-                x = 0; // Reset x to column 0
-                break;
-
-            default:
-                // Print character at current cursor position (x, y)
-                VideoMemory[80*y + x] = (VideoMemory[80*y + x] & 0xFF00) | character;
-                x++;
-                break;
-        }
+// With a linear framebuffer the active terminal renders into textCells
+// instead of VGA memory and GraphicsTextScreen draws whatever changed.
+static uint16_t textCells[TERMINAL_COLUMNS * TERMINAL_ROWS];
+static uint16_t textDrawn[TERMINAL_COLUMNS * TERMINAL_ROWS];
+static uint32_t backBuffer[GRAPHICS_MAX_WIDTH * GRAPHICS_MAX_HEIGHT];
+static int32_t cursorX, cursorY;
 
-        if(x >= 80){
-            x = 0;
-            y++;
-        }
+// FPU/SSE state of the kernel's own thread of execution
+static FpuContext kernelFpu;
 
-        // Basic scrolling
-        if(y >= 25){
-            for(y = 1; y < 25; y++){
-                for(x = 0; x < 80; x++){
-                    VideoMemory[80*(y-1) + x] = VideoMemory[80*y + x];
-                }
-            }
+// Room for the whole FAT of volumes up to 256K clusters (1 GiB at 4 KiB)
+#define FAT_CACHE_ENTRIES (256 * 1024)
+static uint32_t fatCache[FAT_CACHE_ENTRIES];
+static FatFile rootDirectory;
 
-            // Clear the last line
-            for(x = 0; x < 80; x++){
-                VideoMemory[80*24 + x] = 0x0720;
-            }
-            y = 24;
-            x = 0;
-        }
-    }
+extern "C" void printf(const char* str){
+    terminals[0].Write(str);
+}
+
+// Fills the pure virtual slots of abstract classes such as BlockDevice;
+// only a bug can get here
+extern "C" void __cxa_pure_virtual(){
+    printf("pure virtual call\n");
+    while(1)
+        asm volatile("cli; hlt");
 }
 
 void printfHex(uint8_t key) {
@@ -69,43 +67,246 @@ void printfHex(uint8_t key) {
 }
 
 
-class PrintfKeyboardEventHandler : public KeyboardEventHandler
+static const char* decimal(uint32_t value, char* foo) {
+    int i = 10;
+    foo[i] = '\0';
+    do {
+        foo[--i] = '0' + value % 10;
+        value /= 10;
+    } while(value != 0);
+    return foo + i;
+}
+
+void printfDecimal(uint32_t value) {
+    char foo[11];
+    printf(decimal(value, foo));
+}
+
+// QEMU's debugcon, used by `make boot-bench`
+static void debugWrite(const char* str) {
+    Port8Bit debugcon(0xE9);
+    for(uint32_t i = 0; str[i] != '\0'; i++)
+        debugcon.Write(str[i]);
+}
+
+// One "boot <checkpoint> <stage us> <total us>" line per checkpoint
+static void reportBootTimeline(BootTimeline* timeline, uint32_t tscKhz, void (*write)(const char*)) {
+    char foo[11];
+    for(uint32_t i = 0; i < timeline->Count(); i++)
+    {
+        write("boot ");
+        write(timeline->Name(i));
+        write(" ");
+        write(decimal(timeline->StageMicroseconds(i, tscKhz), foo));
+        write(" ");
+        write(decimal(timeline->Microseconds(i, tscKhz), foo));
+        write("\n");
+    }
+    write("boot-total ");
+    write(decimal(timeline->Microseconds(timeline->Count() - 1, tscKhz), foo));
+    write(" us\n");
+}
+
+// Whole-word search of the multiboot command line
+static bool hasBootOption(void* multiboot_structure, uint32_t magicnumber, const char* option) {
+    MultibootInfo* info = (MultibootInfo*)multiboot_structure;
+    if(magicnumber != MULTIBOOT_BOOTLOADER_MAGIC || !(info->flags & MULTIBOOT_INFO_CMDLINE))
+        return false;
+
+    const char* word = (const char*)info->cmdline;
+    while(*word != '\0')
+    {
+        uint32_t i = 0;
+        while(option[i] != '\0' && word[i] == option[i])
+            i++;
+        if(option[i] == '\0' && (word[i] == ' ' || word[i] == '\0'))
+            return true;
+        while(*word != ' ' && *word != '\0')
+            word++;
+        while(*word == ' ')
+            word++;
+    }
+    return false;
+}
+
+void HandleInputEvent(TerminalManager* screen, Framebuffer* framebuffer, const InputEvent& event)
 {
-public:
-    void OnKeyDown(const char c)
+    if(event.type == INPUT_MOUSE_MOVE)
     {
-        char foo[] = " ";
-        foo[0] = c;
-        printf(foo);
+        cursorX += event.dx;
+        cursorY += event.dy;
+        if(cursorX < 0) cursorX = 0;
+        if(cursorY < 0) cursorY = 0;
+        if(cursorX >= framebuffer->Width()) cursorX = framebuffer->Width() - 1;
+        if(cursorY >= framebuffer->Height()) cursorY = framebuffer->Height() - 1;
+        framebuffer->MoveCursor(cursorX, cursorY);
+        return;
     }
-};
+
+    if(screen->HandleKey(event))
+        return;
+
+    if(event.type == INPUT_KEY_DOWN && event.ascii != 0)
+        screen->Active()->PutChar(event.ascii);
+}
 
 typedef void (*constructor)();
 
 extern "C" {
     extern constructor start_ctors;
     extern constructor end_ctors;
+    extern uint8_t kernel_text_end;
+    extern uint8_t kernel_end;
 
     extern void callConstructors(){
     for (constructor* i = &start_ctors; i != &end_ctors ; i++)
             (*i)();
+        constructorsTimestamp = readTimestampCounter();
     }
 
-    extern void kernelMain(void* multiboot_structure, uint32_t /*magicnumber */) {
-        clearScreen();
+    extern void kernelMain(void* multiboot_structure, uint32_t magicnumber) {
+        BootTimeline timeline;
+        timeline.Checkpoint("loader", loaderTimestamp);
+        timeline.Checkpoint("constructors", constructorsTimestamp);
+
+        TerminalManager screen(terminals, NUM_TERMINALS, VideoMemory);
         printf("Welcome to ArchAngel_OS!\n");
         printf("Project is on github.com/Harshit-Dhanwalkar/archangelos");
 
         GlobalDescriptorTable gdt;
         InterruptManager interrupts(&gdt); // Instnaciation of InterruptManager
+        timeline.Checkpoint("gdt/idt/pic");
 
-        PrintfKeyboardEventHandler kbhandler;
-        KeyboardDriver keyboard(&interrupts, &kbhandler);
-        MouseEventHandler mouseHandler;
-        MouseDriver mouse(&interrupts, &mouseHandler);
+        // The TSC calibration runs against the PIT in the background of
+        // everything up to clock.Activate()
+        ClockDriver clock(&interrupts);
+        clock.StartCalibration();
+
+        FloatingPointUnit fpu(&interrupts);
+        fpu.Activate(&kernelFpu);
+        timeline.Checkpoint("fpu");
+
+        PhysicalMemoryManager memory;
+        if(magicnumber == MULTIBOOT_BOOTLOADER_MAGIC)
+            memory.AddMultibootMemoryMap((MultibootInfo*)multiboot_structure);
+        memory.Reserve(0, (uint32_t)&kernel_end); // BIOS area, kernel image, its .bss
+
+        PagingManager paging((uint32_t)&kernel_text_end);
+        paging.Activate();
+        timeline.Checkpoint("memory/paging");
+
+        printf("\nMemory: ");
+        printfDecimal(memory.AvailableFrames() * (FRAME_SIZE >> 20));
+        printf(" MiB free, ");
+        printfDecimal(memory.HighestAddress() >> 20);
+        printf(" MiB addressable");
+        if(paging.NoExecuteSupported())
+            printf(", NX");
+        if(fpu.SimdSupported())
+            printf(", SSE2");
+        printf("\n");
+
+        MultibootInfo* info = (MultibootInfo*)multiboot_structure;
+        uint32_t* lfb = 0;
+        uint32_t lfbWidth = 0, lfbHeight = 0, lfbPitch = 0;
+        if(magicnumber == MULTIBOOT_BOOTLOADER_MAGIC
+            && (info->flags & MULTIBOOT_INFO_FRAMEBUFFER)
+            && info->framebuffer_type == MULTIBOOT_FRAMEBUFFER_RGB
+            && info->framebuffer_bpp == 32
+            && info->framebuffer_width <= GRAPHICS_MAX_WIDTH
+            && info->framebuffer_height <= GRAPHICS_MAX_HEIGHT
+            && info->framebuffer_addr + (uint64_t)info->framebuffer_pitch * info->framebuffer_height <= 0x100000000ULL)
+        {
+            lfbWidth = info->framebuffer_width;
+            lfbHeight = info->framebuffer_height;
+            lfbPitch = info->framebuffer_pitch;
+            lfb = (uint32_t*)paging.MapPhysical((uint32_t)info->framebuffer_addr, lfbPitch * lfbHeight, PAGE_WRITABLE);
+        }
+
+        Framebuffer framebuffer(lfb, lfbWidth, lfbHeight, lfbPitch, backBuffer);
+        GraphicsTextScreen graphicsText(&framebuffer, textCells, textDrawn, TERMINAL_COLUMNS, TERMINAL_ROWS);
+        if(framebuffer.Active())
+        {
+            screen.SetVideo(textCells);
+            cursorX = lfbWidth / 2;
+            cursorY = lfbHeight / 2;
+            framebuffer.MoveCursor(cursorX, cursorY);
+            framebuffer.ShowCursor(true);
+            graphicsText.Update();
+            framebuffer.Flush();
+            printf("Framebuffer: ");
+            printfDecimal(lfbWidth);
+            printf("x");
+            printfDecimal(lfbHeight);
+            printf("\n");
+        }
+        timeline.Checkpoint("framebuffer");
+
+        // Primary master, polled before interrupts are enabled
+        AtaDriver disk(0x1F0, 0x3F6, true);
+        FatFileSystem fileSystem(&disk, fatCache, FAT_CACHE_ENTRIES);
+        if(disk.Identify() && fileSystem.Mount() && fileSystem.Open("/", &rootDirectory))
+        {
+            printf("FAT32: ");
+            printfDecimal(fileSystem.ClusterCount());
+            printf(" clusters of ");
+            printfDecimal(fileSystem.ClusterSize());
+            printf(" bytes\n");
+
+            FatDirectoryEntry entry;
+            while(fileSystem.ReadDirectory(&rootDirectory, &entry))
+            {
+                printf("  ");
+                printf(entry.name);
+                if(entry.attributes & FAT_ATTRIBUTE_DIRECTORY)
+                    printf("/");
+                printf("\n");
+            }
+        }
+        timeline.Checkpoint("disk");
+
+        InputEventQueue input;
+        KeyboardDriver keyboard(&interrupts, &input);
+        MouseDriver mouse(&interrupts, &input);
+        keyboard.Activate();
+        timeline.Checkpoint("keyboard");
+        mouse.Activate(); // probe the mouse while interrupts are still off
+        timeline.Checkpoint("mouse");
+
+        clock.Activate();
+        timeline.Checkpoint("clock");
 
         interrupts.Activate(); // Activation of InterruptManager
+        timeline.Checkpoint("ready");
 
-        while(1);
+        reportBootTimeline(&timeline, clock.TscKhz(), printf);
+        if(hasBootOption(multiboot_structure, magicnumber, "bootbench"))
+        {
+            // Report on the debug console and leave through isa-debug-exit
+            reportBootTimeline(&timeline, clock.TscKhz(), debugWrite);
+            Port8Bit debugExit(0xF4);
+            debugExit.Write(0);
+        }
+
+        // This loop is the consumer end of the drivers' input endpoint
+        IpcEndpoint* endpoint = input.Endpoint();
+        IpcMessage messages[32];
+        while(1)
+        {
+            // Sleep until something arrives, then drain whatever piled up
+            endpoint->Receive(&messages[0]);
+            uint32_t count = 1 + endpoint->ReceiveBatch(&messages[1], 31);
+
+            InputEvent event;
+            for(uint32_t i = 0; i < count; i++)
+                if(InputEventQueue::Decode(messages[i], &event))
+                    HandleInputEvent(&screen, &framebuffer, event);
+
+            if(framebuffer.Active())
+            {
+                graphicsText.Update();
+                framebuffer.Flush();
+            }
+        }
     }
 }
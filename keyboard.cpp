@@ -1,123 +1,160 @@
 #include "interrupts.h"
 #include "keyboard.h"
 
-KeyboardEventHandler::KeyboardEventHandler()
+static const char keymap[0x3A] = {
+    0, 0, '1', '2', '3', '4', '5', '6',
+    '7', '8', '9', '0', 0, 0, 0, 0,
+    'q', 'w', 'e', 'r', 't', 'z', 'u', 'i',
+    'o', 'p', 0, 0, '\n', 0, 'a', 's',
+    'd', 'f', 'g', 'h', 'j', 'k', 'l', 0,
+    0, 0, 0, 0, 'y', 'x', 'c', 'v',
+    'b', 'n', 'm', ',', '.', '-', 0, 0,
+    0, ' '
+};
+
+static const char keymapShift[0x3A] = {
+    0, 0, '!', '"', 0, '$', '%', '&',
+    '/', '(', ')', '=', 0, 0, 0, 0,
+    'Q', 'W', 'E', 'R', 'T', 'Z', 'U', 'I',
+    'O', 'P', 0, 0, '\n', 0, 'A', 'S',
+    'D', 'F', 'G', 'H', 'J', 'K', 'L', 0,
+    0, 0, 0, 0, 'Y', 'X', 'C', 'V',
+    'B', 'N', 'M', ';', ':', '_', 0, 0,
+    0, ' '
+};
+
+ScancodeDecoder::ScancodeDecoder()
 {
+    modifiers = 0;
+    extended = false;
 }
 
-void KeyboardEventHandler::OnKeyDown(char)
+uint8_t ScancodeDecoder::Modifiers()
 {
+    return modifiers;
 }
 
-void KeyboardEventHandler::OnKeyUp(char)
+bool ScancodeDecoder::Decode(uint8_t scancode, InputEvent* event)
 {
+    // Controller replies (ACK, resend, echo, errors) are not keys
+    if(scancode == 0xFA || scancode == 0xFE || scancode == 0xEE
+    || scancode == 0x00 || scancode == 0xFF)
+        return false;
+
+    if(scancode == 0xE0 || scancode == 0xE1)
+    {
+        extended = true;
+        return false;
+    }
+
+    bool release = scancode & 0x80;
+    uint8_t code = (scancode & 0x7F) | (extended ? 0x80 : 0);
+    extended = false;
+
+    // Fake shifts some keyboards wrap around extended keys
+    if(code == (0x80 | KEY_LEFT_SHIFT) || code == (0x80 | KEY_RIGHT_SHIFT))
+        return false;
+
+    uint8_t modifier = 0;
+    switch(code)
+    {
+        case KEY_LEFT_SHIFT:
+        case KEY_RIGHT_SHIFT: modifier = INPUT_MOD_SHIFT; break;
+        case KEY_LEFT_CTRL:
+        case KEY_RIGHT_CTRL:  modifier = INPUT_MOD_CTRL; break;
+        case KEY_LEFT_ALT:
+        case KEY_RIGHT_ALT:   modifier = INPUT_MOD_ALT; break;
+        case KEY_CAPSLOCK:
+            if(!release)
+                modifiers ^= INPUT_MOD_CAPSLOCK;
+            break;
+    }
+    if(release)
+        modifiers &= ~modifier;
+    else
+        modifiers |= modifier;
+
+    char ascii = 0;
+    if(code < sizeof(keymap))
+    {
+        bool shift = modifiers & INPUT_MOD_SHIFT;
+        if('a' <= keymap[code] && keymap[code] <= 'z' && (modifiers & INPUT_MOD_CAPSLOCK))
+            shift = !shift;
+        ascii = shift ? keymapShift[code] : keymap[code];
+    }
+
+    event->type = release ? INPUT_KEY_UP : INPUT_KEY_DOWN;
+    event->modifiers = modifiers;
+    event->code = code;
+    event->ascii = ascii;
+    event->dx = 0;
+    event->dy = 0;
+    return true;
 }
 
-KeyboardDriver::KeyboardDriver(InterruptManager* manager, KeyboardEventHandler *handler)
+
+KeyboardDriver::KeyboardDriver(InterruptManager* manager, InputEventQueue* queue)
 :   InterruptHandler(0x21, manager),
     dataport(0x60),
     commandport(0x64)
 {
-    // while (commandport.Read() & 0x1) {
-    //     dataport.Read();
-    // }
-    // commandport.Write(0xAE); // activate interrupts
-    // commandport.Write(0x20); // get current state
-    // uint8_t status = (dataport.Read() | 1) & ~0x10; //Set right-most bit to 1 and clear the 5th bit
-    // commandport.Write(0x60); // change/set the current state
-    // dataport.Write(status);
-    //
-    // dataport.Write(0xF4); //activate the keyboard inputs
-
-    // this->handler = handler;
+    this->queue = queue;
 }
 
 KeyboardDriver::~KeyboardDriver() {
 }
 
-extern "C" void printf(const char* str);
-void printfHex(uint8_t);
+// Bounded waits on the controller status: a missing or wedged 8042 must
+// not hang the boot
+bool KeyboardDriver::WaitRead() {
+    for(uint32_t i = 0; i < 100000; i++)
+        if(commandport.Read() & 0x1)
+            return true;
+    return false;
+}
 
-void KeyboardDriver::Activate() {
+bool KeyboardDriver::WaitWrite() {
+    for(uint32_t i = 0; i < 100000; i++)
+        if(!(commandport.Read() & 0x2))
+            return true;
+    return false;
+}
 
-    while(commandport.Read() & 0x1) {
+void KeyboardDriver::Activate() {
+    // Drop whatever the BIOS left in the output buffer. It holds a few
+    // bytes at most, so a status bit that never clears is a dead controller.
+    for(uint32_t i = 0; i < 16 && (commandport.Read() & 0x1); i++)
         dataport.Read();
-    };
 
+    WaitWrite();
     commandport.Write(0xae); // activate interrupts
+    WaitWrite();
     commandport.Write(0x20); // read controller command byte
+    WaitRead();
     uint8_t status = (dataport.Read() | 1) & ~0x10; //Set right-most bit to 1 and clear the 5th bit
+    WaitWrite();
     commandport.Write(0x60); // set controller command byte
+    WaitWrite();
     dataport.Write(status);
 
+    WaitWrite();
     dataport.Write(0xF4); //activate the keyboard inputs
+    // Take the ACK, or the next controller command's reply (the mouse's
+    // 0x20) would read it instead
+    if(WaitRead())
+        dataport.Read();
 }
 
 uint32_t KeyboardDriver::HandleInterrupt(uint32_t esp) {
 
     uint8_t key = dataport.Read();
 
-    if(handler == 0)
+    if(queue == 0)
         return esp;
 
-    if(key < 0x80)
-    {
-        switch(key)
-        {
-            case 0x02: handler->OnKeyDown('1'); break;
-            case 0x03: handler->OnKeyDown('2'); break;
-            case 0x04: handler->OnKeyDown('3'); break;
-            case 0x05: handler->OnKeyDown('4'); break;
-            case 0x06: handler->OnKeyDown('5'); break;
-            case 0x07: handler->OnKeyDown('6'); break;
-            case 0x08: handler->OnKeyDown('7'); break;
-            case 0x09: handler->OnKeyDown('8'); break;
-            case 0x0A: handler->OnKeyDown('9'); break;
-            case 0x0B: handler->OnKeyDown('0'); break;
-
-            case 0x10: handler->OnKeyDown('q'); break;
-            case 0x11: handler->OnKeyDown('w'); break;
-            case 0x12: handler->OnKeyDown('e'); break;
-            case 0x13: handler->OnKeyDown('r'); break;
-            case 0x14: handler->OnKeyDown('t'); break;
-            case 0x15: handler->OnKeyDown('z'); break;
-            case 0x16: handler->OnKeyDown('u'); break;
-            case 0x17: handler->OnKeyDown('i'); break;
-            case 0x18: handler->OnKeyDown('o'); break;
-            case 0x19: handler->OnKeyDown('p'); break;
-
-            case 0x1E: handler->OnKeyDown('a'); break;
-            case 0x1F: handler->OnKeyDown('s'); break;
-            case 0x20: handler->OnKeyDown('d'); break;
-            case 0x21: handler->OnKeyDown('f'); break;
-            case 0x22: handler->OnKeyDown('g'); break;
-            case 0x23: handler->OnKeyDown('h'); break;
-            case 0x24: handler->OnKeyDown('j'); break;
-            case 0x25: handler->OnKeyDown('k'); break;
-            case 0x26: handler->OnKeyDown('l'); break;
-
-            case 0x2C: handler->OnKeyDown('y'); break;
-            case 0x2D: handler->OnKeyDown('x'); break;
-            case 0x2E: handler->OnKeyDown('c'); break;
-            case 0x2F: handler->OnKeyDown('v'); break;
-            case 0x30: handler->OnKeyDown('b'); break;
-            case 0x31: handler->OnKeyDown('n'); break;
-            case 0x32: handler->OnKeyDown('m'); break;
-            case 0x33: handler->OnKeyDown(','); break;
-            case 0x34: handler->OnKeyDown('.'); break;
-            case 0x35: handler->OnKeyDown('-'); break;
-
-            case 0x1C: handler->OnKeyDown('\n'); break;
-            case 0x39: handler->OnKeyDown(' '); break;
-
-            default:
-            {
-                printf("KEYBOARD 0x");
-                printfHex(key);
-                break;
-            }
-        }
-    }
+    InputEvent event;
+    if(decoder.Decode(key, &event))
+        queue->PostKey(event.type, event.code, event.ascii, event.modifiers);
 
     return esp;
 }
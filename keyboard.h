@@ -4,14 +4,61 @@
 #include "types.h"
 #include "interrupts.h"
 #include "port.h"
+#include "input.h"
 
 
-class KeyboardEventHandler {
+// Keycodes are scancode set 1 make codes; keys behind the 0xE0 prefix
+// get bit 7 set, which is otherwise only used by break codes.
+enum KeyCode {
+    KEY_ESCAPE      = 0x01,
+    KEY_BACKSPACE   = 0x0E,
+    KEY_TAB         = 0x0F,
+    KEY_ENTER       = 0x1C,
+    KEY_LEFT_CTRL   = 0x1D,
+    KEY_LEFT_SHIFT  = 0x2A,
+    KEY_RIGHT_SHIFT = 0x36,
+    KEY_LEFT_ALT    = 0x38,
+    KEY_SPACE       = 0x39,
+    KEY_CAPSLOCK    = 0x3A,
+    KEY_F1          = 0x3B,
+    KEY_F2          = 0x3C,
+    KEY_F3          = 0x3D,
+    KEY_F4          = 0x3E,
+    KEY_F5          = 0x3F,
+    KEY_F6          = 0x40,
+    KEY_F7          = 0x41,
+    KEY_F8          = 0x42,
+    KEY_F9          = 0x43,
+    KEY_F10         = 0x44,
+    KEY_F11         = 0x57,
+    KEY_F12         = 0x58,
+
+    KEY_RIGHT_CTRL  = 0x80 | 0x1D,
+    KEY_RIGHT_ALT   = 0x80 | 0x38,
+    KEY_HOME        = 0x80 | 0x47,
+    KEY_UP          = 0x80 | 0x48,
+    KEY_PAGE_UP     = 0x80 | 0x49,
+    KEY_LEFT        = 0x80 | 0x4B,
+    KEY_RIGHT       = 0x80 | 0x4D,
+    KEY_END         = 0x80 | 0x4F,
+    KEY_DOWN        = 0x80 | 0x50,
+    KEY_PAGE_DOWN   = 0x80 | 0x51
+};
+
+
+// Turns the raw scancode stream into key events and tracks modifiers.
+// Has no hardware dependencies of its own.
+class ScancodeDecoder {
+    uint8_t modifiers;
+    bool extended;
+
     public:
-        KeyboardEventHandler();
+        ScancodeDecoder();
 
-        virtual void OnKeyDown(char);
-        virtual void OnKeyUp(char);
+        // Returns true and fills type/code/ascii/modifiers when the byte
+        // completes a key event; prefix bytes return false.
+        bool Decode(uint8_t scancode, InputEvent* event);
+        uint8_t Modifiers();
 };
 
 
@@ -19,10 +66,14 @@ class KeyboardDriver : public InterruptHandler {
     Port8Bit dataport;
     Port8Bit commandport;
 
-    KeyboardEventHandler* handler;
+    ScancodeDecoder decoder;
+    InputEventQueue* queue;
+
+    bool WaitRead();
+    bool WaitWrite();
 
     public:
-        KeyboardDriver(InterruptManager* manager, KeyboardEventHandler *handler);
+        KeyboardDriver(InterruptManager* manager, InputEventQueue* queue);
         ~KeyboardDriver();
         virtual uint32_t HandleInterrupt(uint32_t esp);
         virtual void Activate();
@@ -1,24 +1,37 @@
 .set MAGIC, 0x1badb002
-.set FLAGS, (1<<0 | 1<<1)
+.set FLAGS, (1<<0 | 1<<1 | 1<<2) # align modules, memory map, video mode
 .set CHECKSUM, -(MAGIC + FLAGS)
 
 
-.section multiboot
+.section .multiboot
     .long MAGIC
     .long FLAGS
     .long CHECKSUM
+    .long 0, 0, 0, 0, 0 # load addresses, only used with flag 16
+    .long 0             # linear framebuffer
+    .long 1024          # preferred width
+    .long 768           # preferred height
+    .long 32            # bits per pixel
 
 
 .section .text
 .extern kernelMain
 .extern callConstructors
+.extern loaderTimestamp
 .global loader
 
 
 loader:
+    # First boot timeline checkpoint; eax holds the multiboot magic
+    mov %eax, %esi
+    rdtsc
+    mov %eax, loaderTimestamp
+    mov %edx, loaderTimestamp+4
+
     mov $kernel_stack, %esp
+    # esi/ebx survive the call, eax would not
     call callConstructors
-    push %eax
+    push %esi
     push %ebx
     call kernelMain
 
@@ -0,0 +1,133 @@
+#include "memory.h"
+
+
+PhysicalMemoryManager::PhysicalMemoryManager()
+{
+    for(uint32_t i = 0; i < MEMORY_MAX_FRAMES / 32; i++)
+        freeFrames[i] = 0;
+    totalFrames = 0;
+    availableFrames = 0;
+    highestAddress = 0;
+}
+
+PhysicalMemoryManager::~PhysicalMemoryManager()
+{
+}
+
+void PhysicalMemoryManager::AddRegion(uint64_t base, uint64_t length)
+{
+    uint64_t first = (base + FRAME_SIZE - 1) >> FRAME_SHIFT;
+    uint64_t end = (base + length) >> FRAME_SHIFT;
+    if(end > MEMORY_MAX_FRAMES)
+        end = MEMORY_MAX_FRAMES;
+    if(first < end && (end << FRAME_SHIFT) > highestAddress)
+        highestAddress = end << FRAME_SHIFT;
+
+    for(uint64_t frame = first; frame < end; frame++)
+    {
+        uint32_t bit = 1u << (frame & 31);
+        if(freeFrames[frame >> 5] & bit)
+            continue;
+        freeFrames[frame >> 5] |= bit;
+        totalFrames++;
+        availableFrames++;
+    }
+}
+
+void PhysicalMemoryManager::Reserve(uint64_t base, uint64_t length)
+{
+    // Any frame the range touches, even partly
+    uint64_t first = base >> FRAME_SHIFT;
+    uint64_t end = (base + length + FRAME_SIZE - 1) >> FRAME_SHIFT;
+    if(end > MEMORY_MAX_FRAMES)
+        end = MEMORY_MAX_FRAMES;
+
+    for(uint64_t frame = first; frame < end; frame++)
+    {
+        uint32_t bit = 1u << (frame & 31);
+        if(!(freeFrames[frame >> 5] & bit))
+            continue;
+        freeFrames[frame >> 5] &= ~bit;
+        totalFrames--;
+        availableFrames--;
+    }
+}
+
+void PhysicalMemoryManager::AddMultibootMemoryMap(MultibootInfo* info)
+{
+    if(info->flags & MULTIBOOT_INFO_MEMORY_MAP)
+    {
+        uint32_t offset = 0;
+        while(offset < info->mmap_length)
+        {
+            MultibootMemoryMap* entry = (MultibootMemoryMap*)(size_t)(info->mmap_addr + offset);
+            if(entry->type == MULTIBOOT_MEMORY_AVAILABLE)
+                AddRegion(entry->addr, entry->len);
+            offset += entry->size + 4;
+        }
+    }
+    else if(info->flags & MULTIBOOT_INFO_MEMORY)
+    {
+        AddRegion(0x100000, (uint64_t)info->mem_upper * 1024);
+    }
+}
+
+uint64_t PhysicalMemoryManager::Allocate(uint32_t first, uint32_t last, bool downwards)
+{
+    // Scan a word at a time; last is exclusive
+    int32_t step = downwards ? -1 : 1;
+    int32_t word = downwards ? (int32_t)((last - 1) >> 5) : (int32_t)(first >> 5);
+    int32_t stop = downwards ? (int32_t)(first >> 5) - 1 : (int32_t)((last + 31) >> 5);
+
+    for(; word != stop; word += step)
+    {
+        uint32_t bits = freeFrames[word];
+        if(bits == 0)
+            continue;
+
+        for(int32_t i = downwards ? 31 : 0; 0 <= i && i < 32; i += step)
+        {
+            uint32_t frame = word * 32 + i;
+            if(frame < first || frame >= last || !(bits & (1u << i)))
+                continue;
+            freeFrames[word] &= ~(1u << i);
+            availableFrames--;
+            return (uint64_t)frame << FRAME_SHIFT;
+        }
+    }
+    return MEMORY_NO_FRAME;
+}
+
+uint64_t PhysicalMemoryManager::AllocateFrame()
+{
+    return Allocate(0, MEMORY_MAX_FRAMES, true);
+}
+
+uint64_t PhysicalMemoryManager::AllocateLowFrame()
+{
+    return Allocate(0, MEMORY_LOWMEM_LIMIT >> FRAME_SHIFT, false);
+}
+
+void PhysicalMemoryManager::FreeFrame(uint64_t frame)
+{
+    uint64_t n = frame >> FRAME_SHIFT;
+    if(n >= MEMORY_MAX_FRAMES || (freeFrames[n >> 5] & (1u << (n & 31))))
+        return;
+    freeFrames[n >> 5] |= 1u << (n & 31);
+    availableFrames++;
+}
+
+uint32_t PhysicalMemoryManager::TotalFrames()
+{
+    return totalFrames;
+}
+
+uint32_t PhysicalMemoryManager::AvailableFrames()
+{
+    return availableFrames;
+}
+
+uint64_t PhysicalMemoryManager::HighestAddress()
+{
+    return highestAddress;
+}
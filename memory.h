@@ -0,0 +1,51 @@
+#ifndef __MEMORY_H
+#define __MEMORY_H
+
+#include "types.h"
+#include "multiboot.h"
+
+// Physical memory is handed out in 2 MiB frames, the PAE large page size
+#define FRAME_SHIFT 21
+#define FRAME_SIZE (1ULL << FRAME_SHIFT)
+
+// 36-bit physical addresses (PAE on current CPUs)
+#define MEMORY_MAX_FRAMES ((64ULL << 30) >> FRAME_SHIFT)
+
+// Physical memory below this is identity mapped and directly usable by the
+// kernel; everything above, including RAM beyond 4 GiB, is high memory that
+// has to be mapped through PagingManager::MapHighMemory().
+#define MEMORY_LOWMEM_LIMIT 0x38000000ULL
+
+#define MEMORY_NO_FRAME 0xFFFFFFFFFFFFFFFFULL
+
+
+class PhysicalMemoryManager {
+    uint32_t freeFrames[MEMORY_MAX_FRAMES / 32]; // bit set = frame is free
+    uint32_t totalFrames;
+    uint32_t availableFrames;
+    uint64_t highestAddress;
+
+    uint64_t Allocate(uint32_t first, uint32_t last, bool downwards);
+
+    public:
+        PhysicalMemoryManager();
+        ~PhysicalMemoryManager();
+
+        // Only whole frames inside [base, base+length) become usable
+        void AddRegion(uint64_t base, uint64_t length);
+        void Reserve(uint64_t base, uint64_t length);
+        void AddMultibootMemoryMap(MultibootInfo* info);
+
+        // Prefers high memory, so direct-mapped frames stay available for
+        // the kernel. Returns MEMORY_NO_FRAME when exhausted.
+        uint64_t AllocateFrame();
+        // A frame below MEMORY_LOWMEM_LIMIT, usable at virtual == physical
+        uint64_t AllocateLowFrame();
+        void FreeFrame(uint64_t frame);
+
+        uint32_t TotalFrames();
+        uint32_t AvailableFrames();
+        uint64_t HighestAddress(); // end of the highest usable frame
+};
+
+#endif // !__MEMORY_H
@@ -2,58 +2,96 @@
 #include "mouse.h"
 
 
-MouseEventHandler::MouseEventHandler()
+MouseDriver::MouseDriver(InterruptManager* manager, InputEventQueue* queue)
+:   InterruptHandler(0x2C, manager),
+    dataport(0x60),
+    commandport(0x64)
 {
+    this->queue = queue;
+    offset = 0;
+    packetSize = 3;
+    buttons = 0;
+    sampleRate = 100;
+    resolution = 2;
 }
 
-void MouseEventHandler::OnActivate()
-{
+MouseDriver::~MouseDriver() {
 }
 
-void MouseEventHandler::OnMouseDown(uint8_t button)
-{
+void MouseDriver::SetSampleRate(uint8_t rate) {
+    sampleRate = rate;
 }
 
-void MouseEventHandler::OnMouseUp(uint8_t button)
-{
+void MouseDriver::SetResolution(uint8_t resolution) {
+    this->resolution = resolution & 0x3;
 }
 
-void MouseEventHandler::OnMouseMove(int x, int y)
-{
+bool MouseDriver::HasWheel() {
+    return packetSize == 4;
 }
 
+bool MouseDriver::WaitRead() {
+    for(uint32_t i = 0; i < 100000; i++)
+        if(commandport.Read() & 0x1)
+            return true;
+    return false;
+}
 
-MouseDriver::MouseDriver(InterruptManager* manager, MouseEventHandler* handler)
-:   InterruptHandler(0x2C, manager),
-    dataport(0x60),
-    commandport(0x64)
-{
-    this->handler = handler;
+bool MouseDriver::WaitWrite() {
+    for(uint32_t i = 0; i < 100000; i++)
+        if(!(commandport.Read() & 0x2))
+            return true;
+    return false;
 }
 
-MouseDriver::~MouseDriver() {
+uint8_t MouseDriver::Command(uint8_t command) {
+    WaitWrite();
+    commandport.Write(0xD4); // next data byte goes to the mouse
+    WaitWrite();
+    dataport.Write(command);
+    if(!WaitRead())
+        return 0;
+    return dataport.Read(); // 0xFA = ACK
+}
+
+uint8_t MouseDriver::Command(uint8_t command, uint8_t argument) {
+    Command(command);
+    return Command(argument);
 }
 
+bool MouseDriver::EnableWheel() {
+    // IntelliMouse knock: sample rates 200, 100, 80 switch the device to ID 3
+    Command(0xF3, 200);
+    Command(0xF3, 100);
+    Command(0xF3, 80);
+
+    if(Command(0xF2) != 0xFA || !WaitRead())
+        return false;
+    uint8_t id = dataport.Read();
+    return id == 3 || id == 4;
+}
 
 void MouseDriver::Activate() {
     offset = 0;
+    packetSize = 3;
     buttons = 0;
 
-    if(handler != 0)
-        handler->OnActivate();
-
     commandport.Write(0xA8); // activate interrupts
     commandport.Write(0x20); // get current state
+    WaitRead();
     uint8_t status = dataport.Read() | 2; //Set right-most bit to 2
+    WaitWrite();
     commandport.Write(0x60); // change/set the current state
+    WaitWrite();
     dataport.Write(status);
 
-    commandport.Write(0xD4);
-    dataport.Write(0xF4); //activate the mouse inputs
-    dataport.Read();
-}
+    if(EnableWheel())
+        packetSize = 4;
 
-extern "C" void printf(char* str);
+    Command(0xF3, sampleRate);
+    Command(0xE8, resolution);
+    Command(0xF4); //activate the mouse inputs
+}
 
 uint32_t MouseDriver::HandleInterrupt(uint32_t esp) {
 
@@ -63,26 +101,44 @@ uint32_t MouseDriver::HandleInterrupt(uint32_t esp) {
 
     buffer[offset] = dataport.Read();
 
-    if(handler == 0)
+    if(queue == 0)
+        return esp;
+
+    // Bit 3 of the first byte is always set; drop bytes until we see one
+    // so a lost byte cannot shift every following packet.
+    if(offset == 0 && !(buffer[0] & 0x08))
         return esp;
 
-    offset = (offset + 1) % 3;
+    offset = (offset + 1) % packetSize;
 
     if(offset == 0)
     {
-        if(buffer[1] != 0 || buffer[2] != 0)
+        // Overflowed deltas are garbage, keep only the button state
+        if(!(buffer[0] & 0xC0))
+        {
+            // 9-bit two's complement, sign bits live in the first byte
+            int dx = (int)buffer[1] - ((buffer[0] << 4) & 0x100);
+            int dy = (int)buffer[2] - ((buffer[0] << 3) & 0x100);
+            if(dx != 0 || dy != 0)
+                queue->PostMouseMove(dx, -dy);
+        }
+
+        if(packetSize == 4)
         {
-            handler->OnMouseMove((int8_t)buffer[1], -((int8_t)buffer[2]));
+            int dz = (int8_t)(buffer[3] << 4) >> 4;
+            if(dz != 0)
+                queue->PostMouseWheel(dz);
         }
 
+        // Queued after the motion of the same packet, so ordering holds
         for(uint8_t i = 0; i < 3; i++)
         {
             if((buffer[0] & (0x1<<i)) != (buttons & (0x1<<i)))
             {
                 if(buttons & (0x1<<i))
-                    handler->OnMouseUp(i+1);
+                    queue->PostMouseButton(INPUT_MOUSE_UP, i+1);
                 else
-                    handler->OnMouseDown(i+1);
+                    queue->PostMouseButton(INPUT_MOUSE_DOWN, i+1);
             }
         }
         buttons = buffer[0];
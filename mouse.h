@@ -4,35 +4,39 @@
 #include "types.h"
 #include "interrupts.h"
 #include "port.h"
-#include "keyboard.h"
-
-
-class MouseEventHandler {
-    public:
-        MouseEventHandler();
-
-        virtual void OnActivate();
-        virtual void OnMouseDown(uint8_t button);
-        virtual void OnMouseUp(uint8_t button);
-        virtual void OnMouseMove(int x, int y);
-};
+#include "input.h"
 
 
 class MouseDriver : public InterruptHandler {
     Port8Bit dataport;
     Port8Bit commandport;
 
-    uint8_t buffer[3];
+    uint8_t buffer[4];
     uint8_t offset;
+    uint8_t packetSize; // 3 for a standard mouse, 4 once IntelliMouse mode is on
     uint8_t buttons;
 
-    MouseEventHandler* handler;
+    uint8_t sampleRate; // reports per second
+    uint8_t resolution; // 0..3 => 1, 2, 4, 8 counts/mm
+
+    InputEventQueue* queue;
+
+    bool WaitRead();
+    bool WaitWrite();
+    uint8_t Command(uint8_t command);
+    uint8_t Command(uint8_t command, uint8_t argument);
+    bool EnableWheel();
 
     public:
-        MouseDriver(InterruptManager* manager, MouseEventHandler* handler);
+        MouseDriver(InterruptManager* manager, InputEventQueue* queue);
         ~MouseDriver();
         virtual uint32_t HandleInterrupt(uint32_t esp);
         virtual void Activate();
+
+        // Only take effect on the next Activate()
+        void SetSampleRate(uint8_t rate);
+        void SetResolution(uint8_t resolution);
+        bool HasWheel();
 };
 
 #endif // !__MOUSE_H
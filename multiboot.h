@@ -0,0 +1,58 @@
+#ifndef __MULTIBOOT_H
+#define __MULTIBOOT_H
+
+#include "types.h"
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+#define MULTIBOOT_INFO_MEMORY     (1<<0)
+#define MULTIBOOT_INFO_CMDLINE    (1<<2)
+#define MULTIBOOT_INFO_MEMORY_MAP (1<<6)
+#define MULTIBOOT_INFO_FRAMEBUFFER (1<<12)
+
+#define MULTIBOOT_FRAMEBUFFER_RGB 1
+#define MULTIBOOT_FRAMEBUFFER_TEXT 2
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+// Boot information the loader hands to kernelMain (Multiboot 0.6.96, 3.3)
+struct MultibootInfo {
+    uint32_t flags;
+    uint32_t mem_lower;      // KiB below 1 MiB
+    uint32_t mem_upper;      // KiB above 1 MiB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+    uint32_t vbe_control_info;
+    uint32_t vbe_mode_info;
+    uint16_t vbe_mode;
+    uint16_t vbe_interface_seg;
+    uint16_t vbe_interface_off;
+    uint16_t vbe_interface_len;
+    uint64_t framebuffer_addr;
+    uint32_t framebuffer_pitch;  // bytes per scanline
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint8_t framebuffer_bpp;
+    uint8_t framebuffer_type;
+    uint8_t framebuffer_color_info[6];
+} __attribute__((packed));
+
+// `size` does not count itself: the next entry is at this + size + 4
+struct MultibootMemoryMap {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed));
+
+#endif // __MULTIBOOT_H
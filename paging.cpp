@@ -0,0 +1,201 @@
+#include "paging.h"
+#include "cpu.h"
+
+#define ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+#define LARGE_ADDRESS_MASK 0x000FFFFFFFE00000ULL
+
+#define CR0_WRITE_PROTECT (1<<16)
+#define CR0_PAGING        (1<<31)
+#define CR4_PAE           (1<<5)
+#define MSR_EFER          0xC0000080
+#define EFER_NXE          (1<<11)
+
+
+uint64_t PagingManager::pageDirectoryPointerTable[4];
+uint64_t PagingManager::pageDirectories[4][512];
+uint64_t PagingManager::pageTables[PAGING_PAGE_TABLES][512];
+
+PagingManager::PagingManager(uint32_t kernelTextEnd)
+{
+    usedPageTables = 0;
+    highMemorySlots = 0;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    noExecute = 0;
+    if(eax >= 0x80000001)
+    {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        if(edx & (1<<20))
+            noExecute = PAGE_NO_EXECUTE;
+    }
+
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        for(uint32_t j = 0; j < 512; j++)
+            pageDirectories[i][j] = 0;
+        // PDPT entries only take the present bit in PAE mode
+        pageDirectoryPointerTable[i] = (size_t)pageDirectories[i] | PAGE_PRESENT;
+    }
+
+    // Only the large pages holding kernel text stay executable
+    for(uint32_t address = 0; address < MEMORY_LOWMEM_LIMIT; address += LARGE_PAGE_SIZE)
+    {
+        uint64_t flags = PAGE_PRESENT | PAGE_WRITABLE;
+        if(address >= kernelTextEnd)
+            flags |= PAGE_NO_EXECUTE;
+        MapLargePage(address, address, flags);
+    }
+}
+
+PagingManager::~PagingManager()
+{
+}
+
+void PagingManager::Activate()
+{
+    if(noExecute)
+        writeMSR(MSR_EFER, readMSR(MSR_EFER) | EFER_NXE);
+
+    writeCR4(readCR4() | CR4_PAE);
+    writeCR3((uint32_t)(size_t)pageDirectoryPointerTable);
+    writeCR0(readCR0() | CR0_PAGING | CR0_WRITE_PROTECT);
+}
+
+bool PagingManager::NoExecuteSupported()
+{
+    return noExecute != 0;
+}
+
+uint64_t* PagingManager::DirectoryEntry(uint32_t address)
+{
+    return &pageDirectories[address >> 30][(address >> 21) & 511];
+}
+
+bool PagingManager::MapLargePage(uint32_t address, uint64_t physical, uint64_t flags)
+{
+    if((address | physical) & (LARGE_PAGE_SIZE - 1))
+        return false;
+
+    uint64_t* entry = DirectoryEntry(address);
+    if((*entry & PAGE_PRESENT) && !(*entry & PAGE_LARGE))
+        return false; // has a page table of 4 KiB pages
+
+    *entry = physical | (flags & ~PAGE_NO_EXECUTE) | (flags & noExecute) | PAGE_PRESENT | PAGE_LARGE;
+    invalidatePage(address);
+    return true;
+}
+
+bool PagingManager::MapPage(uint32_t address, uint64_t physical, uint64_t flags)
+{
+    if((address | physical) & (PAGE_SIZE - 1))
+        return false;
+
+    uint64_t* entry = DirectoryEntry(address);
+    if(*entry & PAGE_LARGE)
+        return false;
+
+    if(!(*entry & PAGE_PRESENT))
+    {
+        if(usedPageTables == PAGING_PAGE_TABLES)
+            return false;
+        uint64_t* table = pageTables[usedPageTables++];
+        for(uint32_t i = 0; i < 512; i++)
+            table[i] = 0;
+        // Permissions are decided per page, keep the directory permissive
+        *entry = (size_t)table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    }
+
+    uint64_t* table = (uint64_t*)(size_t)(*entry & ADDRESS_MASK);
+    table[(address >> 12) & 511] = physical | (flags & ~PAGE_NO_EXECUTE) | (flags & noExecute) | PAGE_PRESENT;
+    invalidatePage(address);
+    return true;
+}
+
+uint64_t PagingManager::UnmapPage(uint32_t address)
+{
+    uint64_t* entry = DirectoryEntry(address);
+    if(!(*entry & PAGE_PRESENT))
+        return MEMORY_NO_FRAME;
+
+    uint64_t physical;
+    if(*entry & PAGE_LARGE)
+    {
+        physical = *entry & LARGE_ADDRESS_MASK;
+        *entry = 0;
+    }
+    else
+    {
+        uint64_t* page = (uint64_t*)(size_t)(*entry & ADDRESS_MASK) + ((address >> 12) & 511);
+        if(!(*page & PAGE_PRESENT))
+            return MEMORY_NO_FRAME;
+        physical = *page & ADDRESS_MASK;
+        *page = 0;
+    }
+
+    invalidatePage(address);
+    return physical;
+}
+
+uint64_t PagingManager::Translate(uint32_t address)
+{
+    uint64_t entry = *DirectoryEntry(address);
+    if(!(entry & PAGE_PRESENT))
+        return MEMORY_NO_FRAME;
+    if(entry & PAGE_LARGE)
+        return (entry & LARGE_ADDRESS_MASK) | (address & (LARGE_PAGE_SIZE - 1));
+
+    uint64_t page = ((uint64_t*)(size_t)(entry & ADDRESS_MASK))[(address >> 12) & 511];
+    if(!(page & PAGE_PRESENT))
+        return MEMORY_NO_FRAME;
+    return (page & ADDRESS_MASK) | (address & (PAGE_SIZE - 1));
+}
+
+bool PagingManager::IsSmallPage(uint32_t address)
+{
+    uint64_t entry = *DirectoryEntry(address);
+    if(!(entry & PAGE_PRESENT) || (entry & PAGE_LARGE))
+        return false;
+    uint64_t page = ((uint64_t*)(size_t)(entry & ADDRESS_MASK))[(address >> 12) & 511];
+    return page & PAGE_PRESENT;
+}
+
+void* PagingManager::MapPhysical(uint32_t physical, uint32_t size, uint64_t flags)
+{
+    uint32_t first = physical & ~(LARGE_PAGE_SIZE - 1);
+    uint64_t end = (uint64_t)physical + size;
+    for(uint64_t address = first; address < end; address += LARGE_PAGE_SIZE)
+        if(!MapLargePage(address, address, flags | PAGE_NO_EXECUTE))
+            return 0;
+    return (void*)(size_t)physical;
+}
+
+void* PagingManager::MapHighMemory(uint64_t frame)
+{
+    if(frame < MEMORY_LOWMEM_LIMIT)
+        return (void*)(size_t)frame;
+
+    for(uint32_t slot = 0; slot < PAGING_HIGHMEM_SLOTS; slot++)
+    {
+        if(highMemorySlots & (1u << slot))
+            continue;
+        uint32_t address = PAGING_HIGHMEM_WINDOW + slot * LARGE_PAGE_SIZE;
+        if(!MapLargePage(address, frame, PAGE_WRITABLE | PAGE_NO_EXECUTE))
+            return 0;
+        highMemorySlots |= 1u << slot;
+        return (void*)(size_t)address;
+    }
+    return 0;
+}
+
+void PagingManager::UnmapHighMemory(void* address)
+{
+    uint32_t virt = (uint32_t)(size_t)address;
+    if(virt < PAGING_HIGHMEM_WINDOW)
+        return;
+    uint32_t slot = (virt - PAGING_HIGHMEM_WINDOW) / LARGE_PAGE_SIZE;
+    if(slot >= PAGING_HIGHMEM_SLOTS || !(highMemorySlots & (1u << slot)))
+        return;
+    UnmapPage(PAGING_HIGHMEM_WINDOW + slot * LARGE_PAGE_SIZE);
+    highMemorySlots &= ~(1u << slot);
+}
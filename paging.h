@@ -0,0 +1,66 @@
+#ifndef __PAGING_H
+#define __PAGING_H
+
+#include "types.h"
+#include "memory.h"
+
+#define PAGE_PRESENT       0x001
+#define PAGE_WRITABLE      0x002
+#define PAGE_USER          0x004
+#define PAGE_WRITE_THROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010
+#define PAGE_LARGE         0x080
+#define PAGE_NO_EXECUTE    (1ULL << 63) // dropped when the CPU has no NX
+
+#define PAGE_SIZE       0x1000
+#define LARGE_PAGE_SIZE 0x200000
+
+// Virtual layout above the identity-mapped low memory
+#define PAGING_HIGHMEM_WINDOW 0x38000000 // == MEMORY_LOWMEM_LIMIT
+#define PAGING_HIGHMEM_SLOTS  32         // 2 MiB windows onto high frames
+#define PAGING_SMALL_PAGES    0x3C000000 // area for 4 KiB mappings
+#define PAGING_PAGE_TABLES    16         // each covers 2 MiB of 4 KiB pages
+
+
+// PAE paging: a 4-entry page directory pointer table, four page
+// directories covering 4 GiB and a small pool of page tables. Low memory
+// is identity mapped with 2 MiB pages, non-executable outside the kernel
+// text; physical memory up to 64 GiB is reachable through the high
+// memory window.
+class PagingManager {
+    static uint64_t pageDirectoryPointerTable[4] __attribute__((aligned(32)));
+    static uint64_t pageDirectories[4][512] __attribute__((aligned(4096)));
+    static uint64_t pageTables[PAGING_PAGE_TABLES][512] __attribute__((aligned(4096)));
+
+    uint32_t usedPageTables;
+    uint32_t highMemorySlots; // bit set = window slot in use
+    uint64_t noExecute;       // PAGE_NO_EXECUTE when supported, else 0
+
+    uint64_t* DirectoryEntry(uint32_t address);
+
+    public:
+        PagingManager(uint32_t kernelTextEnd);
+        ~PagingManager();
+
+        // Enables PAE, NX (if the CPU has it) and paging
+        void Activate();
+        bool NoExecuteSupported();
+
+        bool MapLargePage(uint32_t address, uint64_t physical, uint64_t flags);
+        bool MapPage(uint32_t address, uint64_t physical, uint64_t flags);
+        // Returns the physical address that was mapped, or MEMORY_NO_FRAME
+        uint64_t UnmapPage(uint32_t address);
+        uint64_t Translate(uint32_t address);
+        // Mapped by a 4 KiB page table entry rather than a 2 MiB page
+        bool IsSmallPage(uint32_t address);
+
+        // Identity maps a device range below 4 GiB (framebuffers, MMIO)
+        void* MapPhysical(uint32_t physical, uint32_t size, uint64_t flags);
+
+        // Temporary kernel mapping of any 2 MiB frame. Low frames come
+        // back directly; high ones take one of the window slots.
+        void* MapHighMemory(uint64_t frame);
+        void UnmapHighMemory(void* address);
+};
+
+#endif // !__PAGING_H
@@ -0,0 +1,59 @@
+#ifndef __RINGBUFFER_H
+#define __RINGBUFFER_H
+
+#include "types.h"
+
+// Fixed-size single-producer/single-consumer queue. Size must be a power
+// of two. The producer may be an interrupt handler as long as the consumer
+// keeps interrupts off while it touches the queue.
+template<typename T, uint32_t Size>
+class RingBuffer {
+    T items[Size];
+    volatile uint32_t head; // next slot to write
+    volatile uint32_t tail; // next slot to read
+
+    public:
+        RingBuffer() : head(0), tail(0) {}
+
+        bool Empty() { return head == tail; }
+        bool Full() { return head - tail == Size; }
+        uint32_t Count() { return head - tail; }
+        uint32_t Capacity() { return Size; }
+
+        bool Push(const T& item) {
+            if(Full())
+                return false;
+            items[head & (Size - 1)] = item;
+            head = head + 1;
+            return true;
+        }
+
+        // Two-step push for producers that fill the slot in place:
+        // Reserve() returns the next free slot or 0, Commit() publishes it
+        T* Reserve() {
+            if(Full())
+                return 0;
+            return &items[head & (Size - 1)];
+        }
+
+        void Commit() { head = head + 1; }
+
+        bool Pop(T* item) {
+            if(Empty())
+                return false;
+            *item = items[tail & (Size - 1)];
+            tail = tail + 1;
+            return true;
+        }
+
+        // Most recently pushed item that has not been popped yet, or 0
+        T* Newest() {
+            if(Empty())
+                return 0;
+            return &items[(head - 1) & (Size - 1)];
+        }
+
+        void Clear() { tail = head; }
+};
+
+#endif // __RINGBUFFER_H
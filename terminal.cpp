@@ -0,0 +1,251 @@
+#include "terminal.h"
+#include "keyboard.h"
+
+
+VirtualTerminal::VirtualTerminal(char* storage, uint16_t depth)
+{
+    lines = storage;
+    this->depth = depth < TERMINAL_ROWS ? TERMINAL_ROWS : depth;
+    video = 0;
+    Clear();
+}
+
+VirtualTerminal::~VirtualTerminal()
+{
+}
+
+char* VirtualTerminal::Line(uint16_t n)
+{
+    uint32_t slot = first + n;
+    if(slot >= depth)
+        slot -= depth;
+    return lines + slot * TERMINAL_COLUMNS;
+}
+
+uint16_t VirtualTerminal::Top()
+{
+    if(count <= TERMINAL_ROWS)
+        return 0;
+    return count - TERMINAL_ROWS - scroll;
+}
+
+void VirtualTerminal::Render()
+{
+    if(video == 0)
+        return;
+
+    uint16_t top = Top();
+    for(uint16_t row = 0; row < TERMINAL_ROWS; row++)
+    {
+        uint16_t* target = video + TERMINAL_COLUMNS*row;
+        if(top + row < count)
+        {
+            char* line = Line(top + row);
+            for(uint16_t column = 0; column < TERMINAL_COLUMNS; column++)
+                target[column] = 0x0700 | (uint8_t)line[column];
+        }
+        else
+        {
+            for(uint16_t column = 0; column < TERMINAL_COLUMNS; column++)
+                target[column] = 0x0720;
+        }
+    }
+}
+
+void VirtualTerminal::Clear()
+{
+    first = 0;
+    count = 1;
+    x = 0;
+    scroll = 0;
+    for(uint16_t column = 0; column < TERMINAL_COLUMNS; column++)
+        lines[column] = ' ';
+    Render();
+}
+
+void VirtualTerminal::NewLine()
+{
+    if(count < depth)
+        count++;
+    else
+        first = (first + 1 == depth) ? 0 : first + 1;
+
+    char* line = Line(count - 1);
+    for(uint16_t column = 0; column < TERMINAL_COLUMNS; column++)
+        line[column] = ' ';
+    x = 0;
+
+    if(scroll != 0)
+    {
+        // Keep the history the user is reading where it is
+        if(scroll < count - TERMINAL_ROWS)
+            scroll++;
+        else
+            Render(); // the ring dropped the oldest line, the view moved
+        return;
+    }
+
+    if(video == 0)
+        return;
+
+    if(count <= TERMINAL_ROWS)
+    {
+        uint16_t* target = video + TERMINAL_COLUMNS*(count - 1);
+        for(uint16_t column = 0; column < TERMINAL_COLUMNS; column++)
+            target[column] = 0x0720;
+    }
+    else
+    {
+        Render();
+    }
+}
+
+void VirtualTerminal::PutChar(char c)
+{
+    if(c == '\n')
+    {
+        NewLine();
+        return;
+    }
+
+    Line(count - 1)[x] = c;
+
+    if(video != 0 && scroll == 0)
+    {
+        uint16_t row = count - 1 - Top();
+        video[TERMINAL_COLUMNS*row + x] = 0x0700 | (uint8_t)c;
+    }
+
+    x++;
+    if(x >= TERMINAL_COLUMNS)
+        NewLine();
+}
+
+void VirtualTerminal::Write(const char* str)
+{
+    for(int i = 0; str[i] != '\0'; ++i)
+        PutChar(str[i]);
+}
+
+void VirtualTerminal::ScrollBack(uint16_t n)
+{
+    uint16_t limit = count > TERMINAL_ROWS ? count - TERMINAL_ROWS : 0;
+    uint16_t target = (limit - scroll < n) ? limit : scroll + n;
+    if(target == scroll)
+        return;
+    scroll = target;
+    Render();
+}
+
+void VirtualTerminal::ScrollForward(uint16_t n)
+{
+    uint16_t target = scroll < n ? 0 : scroll - n;
+    if(target == scroll)
+        return;
+    scroll = target;
+    Render();
+}
+
+uint16_t VirtualTerminal::ScrollOffset()
+{
+    return scroll;
+}
+
+uint16_t VirtualTerminal::LineCount()
+{
+    return count;
+}
+
+char VirtualTerminal::CharAt(uint16_t row, uint16_t column)
+{
+    uint16_t n = Top() + row;
+    if(n >= count || column >= TERMINAL_COLUMNS)
+        return ' ';
+    return Line(n)[column];
+}
+
+void VirtualTerminal::Attach(uint16_t* video)
+{
+    this->video = video;
+    Render();
+}
+
+void VirtualTerminal::Detach()
+{
+    video = 0;
+}
+
+
+TerminalManager::TerminalManager(VirtualTerminal* terminals, uint8_t count, uint16_t* video)
+{
+    this->terminals = terminals;
+    this->count = count;
+    this->video = video;
+    active = 0;
+    terminals[active].Attach(video);
+}
+
+TerminalManager::~TerminalManager()
+{
+    terminals[active].Detach();
+}
+
+VirtualTerminal* TerminalManager::Terminal(uint8_t n)
+{
+    return n < count ? &terminals[n] : 0;
+}
+
+VirtualTerminal* TerminalManager::Active()
+{
+    return &terminals[active];
+}
+
+uint8_t TerminalManager::ActiveIndex()
+{
+    return active;
+}
+
+void TerminalManager::Switch(uint8_t n)
+{
+    if(n >= count || n == active)
+        return;
+    terminals[active].Detach();
+    active = n;
+    terminals[active].Attach(video);
+}
+
+void TerminalManager::SetVideo(uint16_t* video)
+{
+    this->video = video;
+    terminals[active].Detach();
+    terminals[active].Attach(video);
+}
+
+bool TerminalManager::HandleKey(const InputEvent& event)
+{
+    if(event.type != INPUT_KEY_DOWN)
+        return false;
+
+    if((event.modifiers & INPUT_MOD_ALT) && KEY_F1 <= event.code && event.code <= KEY_F4)
+    {
+        Switch(event.code - KEY_F1);
+        return true;
+    }
+
+    if(event.modifiers & INPUT_MOD_SHIFT)
+    {
+        switch(event.code)
+        {
+            case KEY_PAGE_UP:
+            case KEY_PAGE_UP & 0x7F: // keypad 9
+                terminals[active].ScrollBack(TERMINAL_ROWS - 1);
+                return true;
+            case KEY_PAGE_DOWN:
+            case KEY_PAGE_DOWN & 0x7F: // keypad 3
+                terminals[active].ScrollForward(TERMINAL_ROWS - 1);
+                return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,72 @@
+#ifndef __TERMINAL_H
+#define __TERMINAL_H
+
+#include "types.h"
+#include "input.h"
+
+#define TERMINAL_COLUMNS 80
+#define TERMINAL_ROWS 25
+
+
+// A text console kept entirely in RAM. The last `depth` lines are held in
+// a ring of TERMINAL_COLUMNS-byte rows; only a terminal that is attached
+// to video memory ever writes to it.
+class VirtualTerminal {
+    char* lines;
+    uint16_t depth;
+    uint16_t first;  // ring slot of the oldest line
+    uint16_t count;  // lines in use, at least 1
+    uint16_t x;      // cursor column on the newest line
+    uint16_t scroll; // lines scrolled back from the bottom
+    uint16_t* video; // text mode VRAM while on screen, else 0
+
+    char* Line(uint16_t n); // n-th line counting from the oldest
+    uint16_t Top();         // first line shown on screen
+    void NewLine();
+    void Render();
+
+    public:
+        VirtualTerminal(char* storage, uint16_t depth);
+        ~VirtualTerminal();
+
+        void PutChar(char c);
+        void Write(const char* str);
+        void Clear();
+
+        void ScrollBack(uint16_t n);
+        void ScrollForward(uint16_t n);
+        uint16_t ScrollOffset();
+        uint16_t LineCount();
+
+        // Character currently shown at row/column of the 80x25 view
+        char CharAt(uint16_t row, uint16_t column);
+
+        void Attach(uint16_t* video);
+        void Detach();
+};
+
+
+// Owns the screen: exactly one terminal is attached to VRAM at a time.
+// Alt+F1..F4 switches, Shift+PgUp/PgDn scrolls the active one.
+class TerminalManager {
+    VirtualTerminal* terminals;
+    uint8_t count;
+    uint8_t active;
+    uint16_t* video;
+
+    public:
+        TerminalManager(VirtualTerminal* terminals, uint8_t count, uint16_t* video);
+        ~TerminalManager();
+
+        VirtualTerminal* Terminal(uint8_t n);
+        VirtualTerminal* Active();
+        uint8_t ActiveIndex();
+        void Switch(uint8_t n);
+        // Moves the active terminal to a different cell buffer
+        void SetVideo(uint16_t* video);
+
+        // Returns true if the key was a terminal hotkey and has been consumed
+        bool HandleKey(const InputEvent& event);
+};
+
+#endif // !__TERMINAL_H
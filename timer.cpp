@@ -0,0 +1,216 @@
+#include "timer.h"
+
+
+Timer::Timer()
+{
+    next = 0;
+    pprev = 0;
+    expires = 0;
+    level = 0;
+    slot = 0;
+}
+
+Timer::~Timer()
+{
+}
+
+void Timer::OnExpire()
+{
+}
+
+bool Timer::Pending()
+{
+    return pprev != 0;
+}
+
+uint64_t Timer::Expires()
+{
+    return expires;
+}
+
+
+TimerWheel::TimerWheel(uint64_t now)
+{
+    for(uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        for(uint8_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            slots[level][slot] = 0;
+        occupied[level][0] = 0;
+        occupied[level][1] = 0;
+    }
+    current = now;
+    pending = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+}
+
+void TimerWheel::Link(Timer* timer)
+{
+    uint64_t expires = timer->expires < current ? current : timer->expires;
+    uint64_t delta = expires - current;
+
+    uint8_t level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+
+    // Beyond the reach of the top level: park it at the far end, it gets
+    // re-linked with its real expiry when that slot cascades.
+    if(delta >> (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+        expires = current + (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+    uint8_t slot = (expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->next = slots[level][slot];
+    if(timer->next != 0)
+        timer->next->pprev = &timer->next;
+    slots[level][slot] = timer;
+    timer->pprev = &slots[level][slot];
+    occupied[level][slot >> 5] |= 1u << (slot & 31);
+}
+
+void TimerWheel::Unlink(Timer* timer)
+{
+    *timer->pprev = timer->next;
+    if(timer->next != 0)
+        timer->next->pprev = timer->pprev;
+    timer->next = 0;
+    timer->pprev = 0;
+
+    if(slots[timer->level][timer->slot] == 0)
+        occupied[timer->level][timer->slot >> 5] &= ~(1u << (timer->slot & 31));
+}
+
+void TimerWheel::Add(Timer* timer, uint64_t expires)
+{
+    if(timer->pprev != 0)
+        Unlink(timer);
+    else
+        pending++;
+
+    timer->expires = expires;
+    Link(timer);
+}
+
+void TimerWheel::Cancel(Timer* timer)
+{
+    if(timer->pprev == 0)
+        return;
+    Unlink(timer);
+    pending--;
+}
+
+int TimerWheel::FirstOccupied(uint8_t level, uint8_t from)
+{
+    for(uint8_t word = from >> 5; word < 2; word++)
+    {
+        uint32_t bits = occupied[level][word];
+        if(word == from >> 5)
+            bits &= ~0u << (from & 31);
+        if(bits != 0)
+            return word * 32 + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+void TimerWheel::Cascade(uint8_t level)
+{
+    uint8_t slot = (current >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+
+    Timer* list = slots[level][slot];
+    slots[level][slot] = 0;
+    occupied[level][slot >> 5] &= ~(1u << (slot & 31));
+
+    while(list != 0)
+    {
+        Timer* timer = list;
+        list = timer->next;
+        Link(timer);
+    }
+
+    // Wrapped around this level too: the next one up is due as well
+    if(slot == 0 && level + 1 < TIMER_WHEEL_LEVELS)
+        Cascade(level + 1);
+}
+
+void TimerWheel::Advance(uint64_t now)
+{
+    while(current <= now)
+    {
+        if(pending == 0)
+        {
+            current = now + 1;
+            return;
+        }
+
+        uint8_t index = current & (TIMER_WHEEL_SLOTS - 1);
+        if(index == 0)
+            Cascade(1);
+
+        if(slots[0][index] == 0)
+        {
+            // Nothing due now: jump to the next busy slot or cascade point
+            int next = FirstOccupied(0, index);
+            uint64_t target = next >= 0
+                ? (current & ~(uint64_t)(TIMER_WHEEL_SLOTS - 1)) + next
+                : (current | (TIMER_WHEEL_SLOTS - 1)) + 1;
+            current = target < now + 1 ? target : now + 1;
+            continue;
+        }
+
+        // Move the due list to a local head so callbacks can cancel or
+        // re-arm any timer on it, including ones that have not run yet.
+        Timer* running = slots[0][index];
+        running->pprev = &running;
+        slots[0][index] = 0;
+        occupied[0][index >> 5] &= ~(1u << (index & 31));
+        current++;
+
+        while(running != 0)
+        {
+            Timer* timer = running;
+            running = timer->next;
+            if(running != 0)
+                running->pprev = &running;
+            timer->next = 0;
+            timer->pprev = 0;
+            pending--;
+            timer->OnExpire();
+        }
+    }
+}
+
+bool TimerWheel::NextExpiry(uint64_t* tick)
+{
+    if(pending == 0)
+        return false;
+
+    uint8_t index = current & (TIMER_WHEEL_SLOTS - 1);
+    int next = FirstOccupied(0, index);
+    if(next >= 0)
+    {
+        *tick = (current & ~(uint64_t)(TIMER_WHEEL_SLOTS - 1)) + next;
+        return true;
+    }
+
+    // Everything left is in the next rotation of level 0 or further up
+    uint64_t boundary = (current | (TIMER_WHEEL_SLOTS - 1)) + 1;
+    bool upper = false;
+    for(uint8_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        if(occupied[level][0] | occupied[level][1])
+            upper = true;
+
+    if(upper)
+        *tick = boundary;
+    else
+        *tick = boundary + FirstOccupied(0, 0);
+    return true;
+}
+
+uint32_t TimerWheel::Pending()
+{
+    return pending;
+}
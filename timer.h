@@ -0,0 +1,68 @@
+#ifndef __TIMER_H
+#define __TIMER_H
+
+#include "types.h"
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+class TimerWheel;
+
+// Subclass and override OnExpire(). A timer is owned by the wheel between
+// Add() and either Cancel() or the OnExpire() call, and may re-arm itself
+// from OnExpire().
+class Timer {
+    friend class TimerWheel;
+
+    Timer* next;
+    Timer** pprev;    // the pointer that points at us, 0 when not armed
+    uint64_t expires; // in wheel ticks
+    uint8_t level;
+    uint8_t slot;
+
+    public:
+        Timer();
+        ~Timer();
+
+        virtual void OnExpire();
+
+        bool Pending();
+        uint64_t Expires();
+};
+
+
+// Hierarchical timing wheel: TIMER_WHEEL_LEVELS levels of 64 slots, each
+// level 64 times coarser than the one below. Add and Cancel are O(1);
+// timers further out are cascaded down a level as time reaches them.
+// Time is measured in abstract ticks; ClockDriver uses 2^20 ns.
+class TimerWheel {
+    Timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint32_t occupied[TIMER_WHEEL_LEVELS][2]; // one bit per non-empty slot
+    uint64_t current; // next tick to process
+    uint32_t pending;
+
+    void Link(Timer* timer);
+    void Unlink(Timer* timer);
+    void Cascade(uint8_t level);
+    int FirstOccupied(uint8_t level, uint8_t from);
+
+    public:
+        TimerWheel(uint64_t now);
+        ~TimerWheel();
+
+        // expires <= the current tick fires on the next Advance()
+        void Add(Timer* timer, uint64_t expires);
+        void Cancel(Timer* timer);
+
+        // Runs every timer due at or before now
+        void Advance(uint64_t now);
+
+        // Earliest tick at which Advance() has work to do (a timer to run or
+        // a cascade to perform); false when no timers are armed
+        bool NextExpiry(uint64_t* tick);
+
+        uint32_t Pending();
+};
+
+#endif // !__TIMER_H
@@ -1,6 +1,17 @@
 #ifndef __TYPES_H
 #define __TYPES_H
 
+#ifdef HOST_BUILD
+
+    // Host-side build (make host-test / host-bench): take the C library's
+    // types so kernel sources can be linked against ordinary test programs.
+    #include <stdint.h>
+    #include <stddef.h>
+
+    typedef const char*              string;
+
+#else
+
     typedef char                     int8_t;
     typedef unsigned char           uint8_t;
     typedef short                   int16_t;
@@ -13,4 +24,6 @@
     typedef const char*              string;
     typedef uint32_t                 size_t;
 
+#endif
+
 #endif // __TYPES_H